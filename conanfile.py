@@ -25,6 +25,7 @@ class YcmdConan(ConanFile):
     "nlohmann_json/3.11.2",
     "abseil/20220623.0",
     "gtest/1.15.0",
+    "benchmark/1.8.3",
     "pybind11/2.13.6",
     "function2/4.2.2",
     "xxhash/0.8.2",
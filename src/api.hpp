@@ -193,13 +193,15 @@ namespace ycmd::requests {
 
     Event event_name;
 
-    // tag_files
+    // Only sent if collect_identifiers_from_tags_files is set
+    std::vector<std::string> tag_files;
     // syntax_keywords
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT_AND_BASE(
       EventNotification,
       SimpleRequest,
-      event_name);
+      event_name,
+      tag_files);
   };
 
 #define EVENT( e ) { EventNotification::Event::e, #e },
@@ -315,12 +317,41 @@ namespace ycmd::responses {
 
     json completer;
 
+    // What the interned strings are costing us
+    struct RepositoryUsage {
+      size_t num_elements{0};
+      size_t bytes{0};
+      // 0 if there isn't one
+      size_t budget_bytes{0};
+
+      NLOHMANN_DEFINE_TYPE_INTRUSIVE(
+        RepositoryUsage,
+        num_elements,
+        bytes,
+        budget_bytes
+      );
+    };
+
+    struct Repositories {
+      RepositoryUsage candidates;
+      RepositoryUsage characters;
+      RepositoryUsage code_points;
+
+      NLOHMANN_DEFINE_TYPE_INTRUSIVE(
+        Repositories,
+        candidates,
+        characters,
+        code_points
+      );
+    } repositories;
+
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(
       DebugInfoResponse,
       python,
       clang,
       extra_conf,
-      completer
+      completer,
+      repositories
     );
   };
 }
@@ -0,0 +1,62 @@
+#include "../buffer_token_index.cpp"
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+using namespace ycmd;
+
+namespace
+{
+  std::string SourceFile( size_t num_lines )
+  {
+    std::string contents;
+    for ( size_t i = 0; i < num_lines; ++i )
+    {
+      auto n = std::to_string( i );
+      contents.append( "  auto value_" + n + " = compute( input_" + n +
+                       ", options.threshold );\n" );
+    }
+    return contents;
+  }
+
+  void BM_BufferTokenIndex_Rebuild( benchmark::State& state )
+  {
+    auto contents = SourceFile( state.range( 0 ) );
+
+    for ( auto _ : state )
+    {
+      BufferTokenIndex index( IdentifierLexerForFiletype( "cpp" ) );
+      benchmark::DoNotOptimize( index.Update( contents ) );
+    }
+  }
+
+  // Typing on one line in the middle of the file, as in insert mode.
+  void BM_BufferTokenIndex_SingleLineEdit( benchmark::State& state )
+  {
+    auto contents = SourceFile( state.range( 0 ) );
+    BufferTokenIndex index( IdentifierLexerForFiletype( "cpp" ) );
+    index.Update( contents );
+
+    auto edited = contents;
+    auto middle = edited.find( '\n', edited.size() / 2 );
+    edited.insert( middle, " + extra_term" );
+
+    bool toggle = false;
+    for ( auto _ : state )
+    {
+      toggle = !toggle;
+      benchmark::DoNotOptimize( index.Update( toggle ? edited : contents ) );
+    }
+  }
+}
+
+BENCHMARK( BM_BufferTokenIndex_Rebuild )
+  ->Arg( 1000 )
+  ->Arg( 50000 )
+  ->Unit( benchmark::kMillisecond );
+BENCHMARK( BM_BufferTokenIndex_SingleLineEdit )
+  ->Arg( 1000 )
+  ->Arg( 50000 )
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,167 @@
+#include "../worker_pool.cpp"
+#include "core/IdentifierCompleter.h"
+#include "core/Repository.h"
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+// Queries against a large project's identifiers, most of which the query
+// doesn't match, which is what the candidate index's prefilter is for.
+
+namespace
+{
+  // Identifiers made of a few random words each, e.g. get_buffer_lines_7,
+  // spread over files of 500 identifiers.
+  std::unique_ptr< IdentifierCompleter > Completer( size_t num_identifiers )
+  {
+    static const std::vector< std::string > words{
+      "get", "set", "buffer", "lines", "request", "handle", "file", "path",
+      "candidate", "result", "query", "index", "token", "parse", "update",
+      "count", "Size", "Data", "Type", "Info" };
+    std::mt19937 random( 42 );
+
+    auto completer = std::make_unique< IdentifierCompleter >();
+    std::vector< std::string > identifiers;
+    for ( size_t i = 0; i < num_identifiers; ++i )
+    {
+      std::string identifier;
+      for ( size_t word = 0; word < 3; ++word )
+      {
+        identifier += words[ random() % words.size() ] + "_";
+      }
+      identifiers.push_back( identifier + std::to_string( i ) );
+
+      if ( identifiers.size() == 500 || i + 1 == num_identifiers )
+      {
+        completer->ClearForFileAndAddIdentifiersToDatabase(
+          std::move( identifiers ),
+          "cpp",
+          "/file" + std::to_string( i / 500 ) + ".cpp" );
+        identifiers.clear();
+      }
+    }
+    return completer;
+  }
+
+  void BM_IdentifierDatabase_Query( benchmark::State& state,
+                                    const std::string& query )
+  {
+    auto completer = Completer( state.range( 0 ) );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        completer->CandidatesForQueryAndType( query, "cpp", 10 ) );
+    }
+    state.SetItemsProcessed( state.iterations() * state.range( 0 ) );
+
+    completer.reset();
+    Repository< Candidate >::Instance().ClearElements();
+  }
+
+  // Same as above, but keeping and sorting all of the matches rather than the
+  // best 10.
+  void BM_IdentifierDatabase_QueryAll( benchmark::State& state,
+                                       const std::string& query )
+  {
+    auto completer = Completer( state.range( 0 ) );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        completer->CandidatesForQueryAndType( query, "cpp", 0 ) );
+    }
+    state.SetItemsProcessed( state.iterations() * state.range( 0 ) );
+
+    completer.reset();
+    Repository< Candidate >::Instance().ClearElements();
+  }
+
+  // The queries as the user types the text, a character at a time.
+  void BM_IdentifierDatabase_Typing( benchmark::State& state,
+                                     const std::string& text )
+  {
+    auto completer = Completer( state.range( 0 ) );
+
+    for ( auto _ : state )
+    {
+      for ( size_t length = 1; length <= text.size(); ++length )
+      {
+        benchmark::DoNotOptimize( completer->CandidatesForQueryAndType(
+          std::string_view( text ).substr( 0, length ), "cpp", 10 ) );
+      }
+    }
+    state.SetItemsProcessed( state.iterations() * text.size() );
+
+    completer.reset();
+    Repository< Candidate >::Instance().ClearElements();
+  }
+
+  // Same as BM_IdentifierDatabase_Query, with the queries split between the
+  // threads of a worker pool (and the calling thread), like the server does.
+  void BM_IdentifierDatabase_QueryInParallel( benchmark::State& state,
+                                              const std::string& query )
+  {
+    auto completer = Completer( state.range( 0 ) );
+    auto num_threads = static_cast< size_t >( state.range( 1 ) );
+    ycmd::WorkerPool workers( num_threads );
+    completer->SetParallelFor(
+      [ & ]( size_t num_tasks, const auto& task ) {
+        ycmd::run_parallel( workers, num_threads, num_tasks, task );
+      },
+      num_threads );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        completer->CandidatesForQueryAndType( query, "cpp", 10 ) );
+    }
+    state.SetItemsProcessed( state.iterations() * state.range( 0 ) );
+
+    completer.reset();
+    Repository< Candidate >::Instance().ClearElements();
+  }
+}
+
+// Matches nothing: everything should be rejected by the prefilter.
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_Query, NoMatches, std::string( "jv" ) )
+  ->RangeMultiplier( 10 )
+  ->Range( 100'000, 1'000'000 )
+  ->Unit( benchmark::kMillisecond );
+// Matches a few percent of the identifiers.
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_Query, Selective,
+                   std::string( "cdfq" ) )
+  ->RangeMultiplier( 10 )
+  ->Range( 100'000, 1'000'000 )
+  ->Unit( benchmark::kMillisecond );
+
+// Matches most of the identifiers, so that ranking them is most of the work.
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_Query, Broad, std::string( "gs" ) )
+  ->RangeMultiplier( 10 )
+  ->Range( 100'000, 1'000'000 )
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_QueryAll, Broad, std::string( "gs" ) )
+  ->RangeMultiplier( 10 )
+  ->Range( 100'000, 1'000'000 )
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_Typing, GetBuffer,
+                   std::string( "getbuf" ) )
+  ->RangeMultiplier( 10 )
+  ->Range( 100'000, 1'000'000 )
+  ->Unit( benchmark::kMillisecond );
+
+// Arguments: identifiers, threads
+BENCHMARK_CAPTURE( BM_IdentifierDatabase_QueryInParallel, Selective,
+                   std::string( "cdfq" ) )
+  ->ArgsProduct( { { 100'000, 1'000'000 }, { 1, 2, 4, 8 } } )
+  ->Unit( benchmark::kMillisecond )
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,152 @@
+#include "../identifier_utils.cpp"
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+using namespace ycmd;
+
+namespace
+{
+  // Something resembling a line of minified javascript, of roughly |length|
+  // code points.
+  std::u32string MinifiedLine( size_t length )
+  {
+    constexpr std::u32string_view chunk =
+      U"function(e,t){var n=e.length,r=t||{};for(var i=0;i<n;i++)"
+      U"r[e[i].id]=e[i].value;return r},";
+    std::u32string line;
+    line.reserve( length + chunk.size() );
+    while ( line.size() < length )
+    {
+      line.append( chunk );
+    }
+    return line;
+  }
+
+  void BM_StartOfLongestIdentifierEndingAt_MinifiedLine(
+    benchmark::State& state )
+  {
+    auto line = MinifiedLine( state.range( 0 ) );
+    line.append( U"someIdentifierAtTheEnd" );
+    const auto& lexer = IdentifierLexerForFiletype( "javascript" );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        StartOfLongestIdentifierEndingAt( line.size() + 1, lexer, line ) );
+    }
+  }
+
+  // Minified code often contains very long unbroken "identifiers", such as
+  // hashes or base64 blobs. The cost should be linear in their length.
+  void BM_StartOfLongestIdentifierEndingAt_LongIdentifier(
+    benchmark::State& state )
+  {
+    auto line = MinifiedLine( 1024 );
+    line.append( state.range( 0 ), U'x' );
+    const auto& lexer = IdentifierLexerForFiletype( "javascript" );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        StartOfLongestIdentifierEndingAt( line.size() + 1, lexer, line ) );
+    }
+    state.SetComplexityN( state.range( 0 ) );
+  }
+}
+
+namespace
+{
+  // Something resembling a large generated header: lots of repetitive
+  // declarations, with a handful of distinct identifiers per line.
+  std::string GeneratedHeader( size_t size )
+  {
+    std::string contents;
+    contents.reserve( size + 128 );
+    for ( size_t i = 0; contents.size() < size; ++i )
+    {
+      auto n = std::to_string( i % 5000 );
+      contents.append( "#define REGISTER_" + n + "_OFFSET 0x" + n + "u\n" );
+      contents.append( "static inline uint32_t read_register_" + n +
+                       "( volatile struct device_regs *regs ) {\n" );
+      contents.append( "  return regs->field_" + n +
+                       " & REGISTER_" + n + "_MASK; /* generated */\n}\n" );
+    }
+    return contents;
+  }
+
+  // Roughly what a python module looks like: docstrings, comments and code.
+  std::string PythonModule( size_t size )
+  {
+    std::string contents;
+    contents.reserve( size + 256 );
+    for ( size_t i = 0; contents.size() < size; ++i )
+    {
+      auto n = std::to_string( i % 5000 );
+      contents.append( "def handler_" + n + "( request, options ):\n" );
+      contents.append( "  \"\"\"Handles request kind " + n + ".\n\n"
+                       "  Returns the response, or None.\"\"\"\n" );
+      contents.append( "  # look up the 'handler' table\n" );
+      contents.append( "  return dispatch( request[ 'kind_" + n + "' ], "
+                       "options.get( \"timeout\" ) )\n\n" );
+    }
+    return contents;
+  }
+
+  void BM_IdentifiersFromBuffer( benchmark::State& state,
+                                 std::string filetype,
+                                 std::string contents,
+                                 bool collect_from_comments_and_strings )
+  {
+    api::SimpleRequest::FileData file;
+    file.filetypes = { std::move( filetype ) };
+    file.contents = std::move( contents );
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        IdentifiersFromBuffer( file, collect_from_comments_and_strings ) );
+    }
+    state.SetBytesProcessed( state.iterations() * file.contents.size() );
+  }
+}
+
+BENCHMARK_CAPTURE( BM_IdentifiersFromBuffer,
+                   cpp_64k,
+                   "cpp",
+                   GeneratedHeader( 64 << 10 ),
+                   true )
+  ->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( BM_IdentifiersFromBuffer,
+                   cpp_5M,
+                   "cpp",
+                   GeneratedHeader( 5 << 20 ),
+                   true )
+  ->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( BM_IdentifiersFromBuffer,
+                   cpp_5M_skip_comments_and_strings,
+                   "cpp",
+                   GeneratedHeader( 5 << 20 ),
+                   false )
+  ->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( BM_IdentifiersFromBuffer,
+                   python_5M,
+                   "python",
+                   PythonModule( 5 << 20 ),
+                   true )
+  ->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( BM_IdentifiersFromBuffer,
+                   python_5M_skip_comments_and_strings,
+                   "python",
+                   PythonModule( 5 << 20 ),
+                   false )
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK( BM_StartOfLongestIdentifierEndingAt_MinifiedLine )
+  ->Range( 1 << 10, 1 << 20 );
+BENCHMARK( BM_StartOfLongestIdentifierEndingAt_LongIdentifier )
+  ->RangeMultiplier( 4 )
+  ->Range( 16, 1 << 14 )
+  ->Complexity();
+
+BENCHMARK_MAIN();
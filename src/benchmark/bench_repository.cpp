@@ -0,0 +1,162 @@
+#include "core/Candidate.h"
+#include "core/Repository.h"
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+// How the repositories behave when several threads build candidates at once,
+// e.g. the identifier completer's workers. Run with real time: with a single
+// lock, adding threads makes each of them slower rather than getting more done.
+
+namespace
+{
+  std::vector<std::string> Identifiers( std::string_view prefix, size_t count )
+  {
+    std::vector<std::string> identifiers;
+    identifiers.reserve( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+      identifiers.push_back( std::string( prefix ) + "_identifier_" +
+                             std::to_string( i ) );
+    }
+    return identifiers;
+  }
+
+  // Everything is already in the repository, e.g. re-parsing a buffer.
+  void BM_Repository_GetElements_Hit( benchmark::State& state )
+  {
+    static const auto identifiers = [] {
+      auto identifiers = Identifiers( "hit", 16384 );
+      Repository< Candidate >::Instance().GetElements(
+        std::vector< std::string >( identifiers ) );
+      return identifiers;
+    }();
+
+    std::vector< std::string_view > batch;
+    for ( size_t i = state.thread_index() * 256;
+          batch.size() < 256;
+          i = ( i + 1 ) % identifiers.size() )
+    {
+      batch.push_back( identifiers[ i ] );
+    }
+
+    for ( auto _ : state )
+    {
+      benchmark::DoNotOptimize(
+        Repository< Candidate >::Instance().GetElements( batch ) );
+    }
+    state.SetItemsProcessed( state.iterations() * batch.size() );
+  }
+
+  // Every candidate is new, so is built and inserted, e.g. loading tag files.
+  void BM_Repository_GetElements_Miss( benchmark::State& state )
+  {
+    static std::atomic< size_t > next_batch = 0;
+    if ( state.thread_index() == 0 )
+    {
+      Repository< Candidate >::Instance().ClearElements();
+    }
+
+    for ( auto _ : state )
+    {
+      auto identifiers = Identifiers( "miss" + std::to_string( next_batch++ ),
+                                      128 );
+      benchmark::DoNotOptimize(
+        Repository< Candidate >::Instance().GetElements(
+          std::move( identifiers ) ) );
+    }
+    state.SetItemsProcessed( state.iterations() * 128 );
+  }
+
+  // Building a candidate looks up each of its code points and characters,
+  // which is where most of the repository traffic comes from.
+  void BM_Repository_BuildCandidates( benchmark::State& state )
+  {
+    auto identifiers = Identifiers( "build_" +
+                                      std::to_string( state.thread_index() ),
+                                    64 );
+
+    for ( auto _ : state )
+    {
+      for ( const auto& identifier : identifiers )
+      {
+        benchmark::DoNotOptimize( Candidate( std::string( identifier ) ) );
+      }
+    }
+    state.SetItemsProcessed( state.iterations() * identifiers.size() );
+  }
+
+  // Text which isn't ASCII has to be broken into code points and then
+  // characters: Chinese identifiers, and ones with emoji sequences.
+  void BM_Repository_BuildUnicodeCandidates( benchmark::State& state )
+  {
+    const std::string prefixes[] = {
+      "\u4E2D\u6587\u6807\u8BC6\u7B26",
+      "\U0001F468\u200D\U0001F469\u200D\U0001F467\U0001F1EB\U0001F1F7" };
+    auto identifiers = Identifiers( prefixes[ state.range( 0 ) ], 64 );
+
+    for ( auto _ : state )
+    {
+      for ( const auto& identifier : identifiers )
+      {
+        benchmark::DoNotOptimize( Candidate( std::string( identifier ) ) );
+      }
+    }
+    state.SetItemsProcessed( state.iterations() * identifiers.size() );
+  }
+
+  // What it costs to keep a large project's identifiers, as estimated by the
+  // repository.
+  void BM_Repository_Memory( benchmark::State& state )
+  {
+    auto identifiers = Identifiers( "memory", state.range( 0 ) );
+    auto& repository = Repository< Candidate >::Instance();
+
+    for ( auto _ : state )
+    {
+      state.PauseTiming();
+      repository.ClearElements();
+      state.ResumeTiming();
+
+      for ( size_t i = 0; i < identifiers.size(); i += 4096 )
+      {
+        std::vector< std::string_view > batch(
+          identifiers.begin() + i,
+          identifiers.begin() + std::min( identifiers.size(), i + 4096 ) );
+        repository.GetElements( batch );
+      }
+    }
+
+    state.counters[ "bytes" ] = repository.MemoryUsage();
+    state.counters[ "bytes_per_identifier" ] =
+      double( repository.MemoryUsage() ) / identifiers.size();
+    repository.ClearElements();
+  }
+}
+
+BENCHMARK( BM_Repository_GetElements_Hit )
+  ->ThreadRange( 1, 16 )
+  ->UseRealTime();
+BENCHMARK( BM_Repository_GetElements_Miss )
+  ->ThreadRange( 1, 16 )
+  ->Iterations( 200 )
+  ->UseRealTime();
+BENCHMARK( BM_Repository_BuildCandidates )
+  ->ThreadRange( 1, 16 )
+  ->UseRealTime();
+BENCHMARK( BM_Repository_BuildUnicodeCandidates )
+  ->ArgName( "emoji" )
+  ->Arg( 0 )
+  ->Arg( 1 );
+BENCHMARK( BM_Repository_Memory )
+  ->Arg( 1'000'000 )
+  ->Iterations( 1 )
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK_MAIN();
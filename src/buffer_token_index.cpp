@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "comment_and_string_lexer.cpp"
+#include "identifier_lexer.cpp"
+#include "identifier_utils.cpp"
+
+namespace ycmd
+{
+  // Identifier occurrences in a buffer, line by line, which can be brought up
+  // to date with new buffer contents by re-lexing only the lines which changed.
+  //
+  // Lines are identified by a hash of their contents. On update, the common
+  // prefix and suffix of unchanged lines are kept as they are, and only the
+  // lines in between are lexed. The result of an update is the change in the
+  // set of identifiers in the buffer, which is what the identifier database
+  // needs.
+  //
+  // If comments and strings are being skipped, each line also records whether
+  // it ends inside a multi-line comment or string. An edit which changes that
+  // (e.g. opening a /* comment) re-lexes the following lines until the state
+  // at the start of a line matches what it was before.
+  class BufferTokenIndex
+  {
+  public:
+    struct Diff
+    {
+      // Identifiers which were not in the buffer before. These point into the
+      // index, so are valid until the next Update.
+      std::vector<std::string_view> added;
+      // Identifiers which are no longer anywhere in the buffer.
+      std::vector<std::string> removed;
+    };
+
+    // If comment_and_string_lexer is null, identifiers are collected from
+    // comments and strings too.
+    explicit BufferTokenIndex(
+      const IdentifierLexer& lexer,
+      const CommentAndStringLexer* comment_and_string_lexer = nullptr )
+      : lexer_( &lexer ),
+        comment_and_string_lexer_( comment_and_string_lexer )
+    {
+    }
+
+    Diff Update( std::string_view contents )
+    {
+      // Hashing every line is unavoidable, as we aren't told what changed, but
+      // it is cheap compared to lexing and updating the database.
+      std::vector<std::string_view> new_lines;
+      std::vector<uint64_t> new_hashes;
+      new_lines.reserve( lines_.size() + 1 );
+      new_hashes.reserve( lines_.size() + 1 );
+      for ( size_t start = 0;; )
+      {
+        auto end = contents.find( '\n', start );
+        auto line = contents.substr( start,
+                                     end == std::string_view::npos
+                                       ? std::string_view::npos
+                                       : end - start );
+        new_lines.push_back( line );
+        new_hashes.push_back( XXH3_64bits( line.data(), line.size() ) );
+        if ( end == std::string_view::npos )
+        {
+          break;
+        }
+        start = end + 1;
+      }
+
+      size_t common = std::min( lines_.size(), new_lines.size() );
+      size_t prefix = 0;
+      while ( prefix < common && lines_[ prefix ].hash == new_hashes[ prefix ] )
+      {
+        ++prefix;
+      }
+      size_t suffix = 0;
+      while ( suffix < common - prefix &&
+              lines_[ lines_.size() - suffix - 1 ].hash ==
+                new_hashes[ new_lines.size() - suffix - 1 ] )
+      {
+        ++suffix;
+      }
+
+      Diff diff;
+
+      // Count the new lines before releasing the old ones, so that an
+      // identifier which just moved between changed lines is in neither list.
+      auto state = prefix > 0 ? lines_[ prefix - 1 ].end_state
+                              : CommentAndStringLexer::State::CODE;
+      std::vector<Line> replacement;
+      replacement.reserve( new_lines.size() - suffix - prefix );
+      for ( size_t i = prefix; i < new_lines.size() - suffix; ++i )
+      {
+        replacement.push_back( LexLine( new_lines[ i ],
+                                        new_hashes[ i ],
+                                        state,
+                                        diff.added ) );
+        state = replacement.back().end_state;
+      }
+
+      // The remaining lines are unchanged, but they must be lexed again if
+      // they now start in a different state.
+      while ( suffix > 0 )
+      {
+        size_t old_index = lines_.size() - suffix;
+        auto old_state = old_index > 0 ? lines_[ old_index - 1 ].end_state
+                                       : CommentAndStringLexer::State::CODE;
+        if ( old_state == state )
+        {
+          break;
+        }
+        size_t new_index = new_lines.size() - suffix;
+        replacement.push_back( LexLine( new_lines[ new_index ],
+                                        new_hashes[ new_index ],
+                                        state,
+                                        diff.added ) );
+        state = replacement.back().end_state;
+        --suffix;
+      }
+
+      auto first = lines_.begin() + prefix;
+      auto last = lines_.end() - suffix;
+      for ( auto it = first; it != last; ++it )
+      {
+        ReleaseLine( *it, diff.removed );
+      }
+
+      if ( replacement.size() == static_cast<size_t>( last - first ) )
+      {
+        std::move( replacement.begin(), replacement.end(), first );
+      }
+      else
+      {
+        first = lines_.erase( first, last );
+        lines_.insert( first,
+                       std::make_move_iterator( replacement.begin() ),
+                       std::make_move_iterator( replacement.end() ) );
+      }
+
+      return diff;
+    }
+
+    // All of the distinct identifiers in the buffer.
+    std::vector<std::string_view> Identifiers() const
+    {
+      std::vector<std::string_view> identifiers;
+      identifiers.reserve( counts_.size() );
+      for ( const auto& [ identifier, _ ] : counts_ )
+      {
+        identifiers.push_back( identifier );
+      }
+      return identifiers;
+    }
+
+    // line_num is 1-based. Returns the identifiers on the line in order.
+    std::span<const IdentifierSpan> LineIdentifiers( size_t line_num ) const
+    {
+      if ( line_num < 1 || line_num > lines_.size() )
+      {
+        return {};
+      }
+      return lines_[ line_num - 1 ].identifiers;
+    }
+
+    // line_num is 1-based. Returns the length of the line in bytes.
+    size_t LineLength( size_t line_num ) const
+    {
+      if ( line_num < 1 || line_num > lines_.size() )
+      {
+        return 0;
+      }
+      return lines_[ line_num - 1 ].length;
+    }
+
+    size_t NumLines() const
+    {
+      return lines_.size();
+    }
+
+  private:
+    struct Line
+    {
+      uint64_t hash;
+      size_t length;
+      CommentAndStringLexer::State end_state;
+      // The text of each of these points to a key of counts_
+      std::vector<IdentifierSpan> identifiers;
+    };
+
+    Line LexLine( std::string_view text,
+                  uint64_t hash,
+                  CommentAndStringLexer::State state,
+                  std::vector<std::string_view>& added )
+    {
+      Line line{ hash, text.size(), state, {} };
+      auto lex_code = [&]( std::string_view code ) {
+        lexer_->ForEachIdentifier( code, [&]( std::string_view identifier ) {
+          auto pos = counts_.find( identifier );
+          if ( pos == counts_.end() )
+          {
+            pos = counts_.emplace( identifier, 0 ).first;
+            added.push_back( pos->first );
+          }
+          ++pos->second;
+          line.identifiers.push_back( {
+            static_cast<size_t>( identifier.data() - text.data() ),
+            pos->first
+          } );
+        } );
+      };
+
+      if ( comment_and_string_lexer_ )
+      {
+        line.end_state = comment_and_string_lexer_->ForEachCodeSpan( text,
+                                                                     state,
+                                                                     lex_code );
+      }
+      else
+      {
+        lex_code( text );
+      }
+      return line;
+    }
+
+    void ReleaseLine( const Line& line, std::vector<std::string>& removed )
+    {
+      for ( const auto& identifier : line.identifiers )
+      {
+        auto pos = counts_.find( identifier.text );
+        if ( --pos->second == 0 )
+        {
+          removed.push_back( std::move( counts_.extract( pos ).key() ) );
+        }
+      }
+    }
+
+    const IdentifierLexer* lexer_;
+    const CommentAndStringLexer* comment_and_string_lexer_;
+    std::vector<Line> lines_;
+    // identifier -> number of occurrences in the buffer. The nodes are stable,
+    // so lines can point at the keys.
+    std::unordered_map< std::string,
+                        size_t,
+                        detail::string_hash,
+                        std::equal_to<> > counts_;
+  };
+
+  std::string_view IdentifierUnderCursor( const BufferTokenIndex& index,
+                                          size_t line_num,
+                                          size_t column_num )
+  {
+    if ( column_num - 1 > index.LineLength( line_num ) )
+    {
+      return "";
+    }
+    return IdentifierUnderCursor( index.LineIdentifiers( line_num ),
+                                  column_num - 1 );
+  }
+
+  std::string_view IdentifierBeforeCursor( const BufferTokenIndex& index,
+                                           size_t line_num,
+                                           size_t column_num )
+  {
+    if ( column_num - 1 > index.LineLength( line_num ) )
+    {
+      return "";
+    }
+    return IdentifierBeforeCursor( index.LineIdentifiers( line_num ),
+                                   column_num - 1 );
+  }
+
+  // The index of the request's buffer, brought up to date with its contents.
+  // Identifiers at the cursor count even in comments and strings, so this
+  // can't be one of the identifier completer's indexes. Each thread keeps the
+  // index of the buffer it was last asked about, so asking about it again
+  // only lexes the lines which changed.
+  //
+  // TODO/FIXME: This should work on RequestWrap, but currently there's a
+  // circular include dependency (as request_wrap.cpp includes
+  // identifier_utils.cpp) split out a request_wrap header. or maybe convert
+  // the whole project to modules, just for fun/learning.
+  const BufferTokenIndex& IndexForRequest(
+    const api::SimpleRequest& request_data )
+  {
+    struct RequestIndex
+    {
+      api::FilePath filepath;
+      std::string filetype;
+      BufferTokenIndex index;
+    };
+    thread_local std::optional<RequestIndex> request_index;
+
+    const auto& file = request_data.file_data.at( request_data.filepath );
+    const auto& filetype = file.filetypes[ 0 ];
+    if ( !request_index ||
+         request_index->filepath != request_data.filepath ||
+         request_index->filetype != filetype )
+    {
+      request_index.emplace( RequestIndex{
+        request_data.filepath,
+        filetype,
+        BufferTokenIndex( IdentifierLexerForFiletype( filetype ) )
+      } );
+    }
+    request_index->index.Update( file.contents );
+    return request_index->index;
+  }
+
+  std::string IdentifierUnderCursor( const api::SimpleRequest& request_data )
+  {
+    return std::string( IdentifierUnderCursor( IndexForRequest( request_data ),
+                                               request_data.line_num,
+                                               request_data.column_num ) );
+  }
+
+  // TODO: The real code in ycmd handles where the identifier is on the
+  // previous line
+  std::string IdentifierBeforeCursor( const api::SimpleRequest& request_data )
+  {
+    return std::string( IdentifierBeforeCursor( IndexForRequest( request_data ),
+                                                request_data.line_num,
+                                                request_data.column_num ) );
+  }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define YCMD_BYTE_CLASSIFIER_X86 1
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#define YCMD_BYTE_CLASSIFIER_NEON 1
+#endif
+
+// Classifies bytes 64 at a time against an arbitrary set of ASCII bytes, using
+// the usual "nibble table" trick: byte b is in the set iff
+//   LOW[ b & 0xf ] & HIGH[ b >> 4 ]
+// is non-zero, where HIGH[ h ] is 1 << h for the 8 ASCII high nibbles, and
+// LOW[ l ] has bit h set iff ( h << 4 | l ) is in the set. Both lookups are a
+// single shuffle instruction on x86 (AVX2) and arm64 (NEON). Non-ASCII bytes
+// are always reported, as they have to be decoded to be classified.
+
+namespace ycmd
+{
+  template< typename CharType >
+  constexpr bool IsAscii( CharType c )
+  {
+    return static_cast< std::make_unsigned_t< CharType > >( c ) < 0x80;
+  }
+
+  struct AsciiByteSet
+  {
+    std::array< uint8_t, 16 > low_nibble_bits{};
+
+    constexpr void Add( uint8_t byte )
+    {
+      low_nibble_bits[ byte & 0xf ] |= uint8_t( 1u << ( byte >> 4 ) );
+    }
+
+    constexpr bool Contains( uint8_t byte ) const
+    {
+      return byte >= 0x80 ||
+        ( low_nibble_bits[ byte & 0xf ] & ( 1u << ( byte >> 4 ) ) ) != 0;
+    }
+  };
+
+  namespace detail
+  {
+    constexpr std::array< uint8_t, 16 > HIGH_NIBBLE_BITS{
+      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+      0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    inline uint64_t ClassifyBlockScalar( const char* block,
+                                         const AsciiByteSet& set )
+    {
+      uint64_t mask = 0;
+      for ( size_t i = 0; i < 64; ++i )
+      {
+        mask |= uint64_t{ set.Contains( static_cast< uint8_t >( block[ i ] ) ) }
+          << i;
+      }
+      return mask;
+    }
+
+#if defined( YCMD_BYTE_CLASSIFIER_X86 )
+    __attribute__(( target( "avx2" ) ))
+    inline uint32_t ClassifyAvx2( __m256i bytes, __m256i low, __m256i high )
+    {
+      const __m256i nibble = _mm256_set1_epi8( 0x0f );
+      __m256i lo = _mm256_shuffle_epi8( low, _mm256_and_si256( bytes, nibble ) );
+      __m256i hi = _mm256_shuffle_epi8(
+        high,
+        _mm256_and_si256( _mm256_srli_epi16( bytes, 4 ), nibble ) );
+      __m256i outside = _mm256_cmpeq_epi8( _mm256_and_si256( lo, hi ),
+                                           _mm256_setzero_si256() );
+      // The sign bit marks non-ASCII bytes, which are always reported.
+      return static_cast< uint32_t >(
+        ~_mm256_movemask_epi8( outside ) | _mm256_movemask_epi8( bytes ) );
+    }
+
+    __attribute__(( target( "avx2" ) ))
+    inline uint64_t ClassifyBlockAvx2( const char* block,
+                                       const AsciiByteSet& set )
+    {
+      __m128i low128 = _mm_loadu_si128(
+        reinterpret_cast< const __m128i* >( set.low_nibble_bits.data() ) );
+      __m128i high128 = _mm_loadu_si128(
+        reinterpret_cast< const __m128i* >( HIGH_NIBBLE_BITS.data() ) );
+      __m256i low = _mm256_broadcastsi128_si256( low128 );
+      __m256i high = _mm256_broadcastsi128_si256( high128 );
+
+      auto first = ClassifyAvx2(
+        _mm256_loadu_si256( reinterpret_cast< const __m256i* >( block ) ),
+        low,
+        high );
+      auto second = ClassifyAvx2(
+        _mm256_loadu_si256( reinterpret_cast< const __m256i* >( block + 32 ) ),
+        low,
+        high );
+      return uint64_t{ first } | ( uint64_t{ second } << 32 );
+    }
+#elif defined( YCMD_BYTE_CLASSIFIER_NEON )
+    inline uint64_t ClassifyBlockNeon( const char* block,
+                                       const AsciiByteSet& set )
+    {
+      const uint8x16_t low = vld1q_u8( set.low_nibble_bits.data() );
+      const uint8x16_t high = vld1q_u8( HIGH_NIBBLE_BITS.data() );
+      const uint8x16_t nibble = vdupq_n_u8( 0x0f );
+      const uint8x16_t weights = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+      };
+
+      uint64_t mask = 0;
+      for ( size_t i = 0; i < 4; ++i )
+      {
+        uint8x16_t bytes = vld1q_u8(
+          reinterpret_cast< const uint8_t* >( block + i * 16 ) );
+        uint8x16_t lo = vqtbl1q_u8( low, vandq_u8( bytes, nibble ) );
+        uint8x16_t hi = vqtbl1q_u8( high, vshrq_n_u8( bytes, 4 ) );
+        uint8x16_t inside = vorrq_u8( vtstq_u8( lo, hi ),
+                                      vcltq_s8( vreinterpretq_s8_u8( bytes ),
+                                                vdupq_n_s8( 0 ) ) );
+        // NEON has no movemask; weight each lane by its bit and add up each
+        // half.
+        uint8x16_t bits = vandq_u8( inside, weights );
+        uint64_t lanes = uint64_t{ vaddv_u8( vget_low_u8( bits ) ) } |
+          ( uint64_t{ vaddv_u8( vget_high_u8( bits ) ) } << 8 );
+        mask |= lanes << ( i * 16 );
+      }
+      return mask;
+    }
+#endif
+
+    using ClassifyBlockFunction = uint64_t (*)( const char*,
+                                                const AsciiByteSet& );
+
+    inline ClassifyBlockFunction SelectClassifyBlock()
+    {
+#if defined( YCMD_BYTE_CLASSIFIER_X86 )
+      if ( __builtin_cpu_supports( "avx2" ) )
+      {
+        return &ClassifyBlockAvx2;
+      }
+      return &ClassifyBlockScalar;
+#elif defined( YCMD_BYTE_CLASSIFIER_NEON )
+      return &ClassifyBlockNeon;
+#else
+      return &ClassifyBlockScalar;
+#endif
+    }
+
+    inline const ClassifyBlockFunction CLASSIFY_BLOCK = SelectClassifyBlock();
+  }
+
+  // Returns a mask with bit i set iff text[ i ] is in |set| (or is not ASCII).
+  // Reads at most 64 bytes; bits past the end of text are clear.
+  inline uint64_t ClassifyBlock( std::string_view text,
+                                 const AsciiByteSet& set )
+  {
+    if ( text.size() >= 64 )
+    {
+      return detail::CLASSIFY_BLOCK( text.data(), set );
+    }
+
+    std::array< char, 64 > padded{};
+    std::memcpy( padded.data(), text.data(), text.size() );
+    return detail::CLASSIFY_BLOCK( padded.data(), set ) &
+      ( ( uint64_t{ 1 } << text.size() ) - 1 );
+  }
+}
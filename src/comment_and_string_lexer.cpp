@@ -0,0 +1,235 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+#include "byte_classifier.cpp"
+
+// Finds the parts of a buffer which are outside of comments and string
+// literals, so that identifiers can optionally be collected only from code.
+//
+// This is a port of the comment and string regexes in identifier_utils.py to a
+// single pass state machine. Rather than replacing comments and strings with
+// blank lines, the lexer reports the spans of code between them, which go
+// straight to the identifier lexer.
+//
+// The rules follow the python ones: single-line strings must be terminated on
+// the same line, and their opening quote must not be preceded by a backslash.
+// The exception is multi-line constructs (/* */ and triple-quoted strings),
+// which are carried from line to line like a real lexer would. An unterminated
+// one runs to the end of the buffer, where python would ignore it.
+
+namespace ycmd
+{
+  struct CommentAndStringSyntax
+  {
+    bool c_comments = false;    // /* ... */
+    bool cpp_comments = false;  // // ...
+    bool hash_comments = false; // # ...
+    bool triple_quotes = false; // ''' ... ''' and """ ... """
+    bool single_quotes = false; // '...'
+    bool double_quotes = false; // "..."
+    bool back_quotes = false;   // `...`
+  };
+
+  class CommentAndStringLexer
+  {
+  public:
+    // What we're in the middle of at the end of a line.
+    enum class State : uint8_t
+    {
+      CODE,
+      C_COMMENT,
+      TRIPLE_SINGLE_QUOTE,
+      TRIPLE_DOUBLE_QUOTE,
+    };
+
+    constexpr explicit CommentAndStringLexer( CommentAndStringSyntax syntax )
+      : syntax_( syntax )
+    {
+      if ( syntax.c_comments || syntax.cpp_comments )
+      {
+        openers_.Add( '/' );
+      }
+      if ( syntax.hash_comments )
+      {
+        openers_.Add( '#' );
+      }
+      if ( syntax.triple_quotes || syntax.single_quotes )
+      {
+        openers_.Add( '\'' );
+      }
+      if ( syntax.triple_quotes || syntax.double_quotes )
+      {
+        openers_.Add( '"' );
+      }
+      if ( syntax.back_quotes )
+      {
+        openers_.Add( '`' );
+      }
+    }
+
+    // Calls f( code ) for each piece of text which is outside comments and
+    // strings, given the state at the start of text. Returns the state at the
+    // end of it. text can be a line or a whole buffer.
+    template< typename F >
+    State ForEachCodeSpan( std::string_view text, State state, F&& f ) const
+    {
+      size_t pos = 0;
+      size_t code_start = 0;
+
+      while ( pos < text.size() )
+      {
+        if ( state != State::CODE )
+        {
+          auto closer = state == State::C_COMMENT ? std::string_view{ "*/" }
+                      : state == State::TRIPLE_SINGLE_QUOTE ? "'''"
+                      : "\"\"\"";
+          auto end = text.find( closer, pos );
+          if ( end == std::string_view::npos )
+          {
+            return state;
+          }
+          pos = end + closer.size();
+          code_start = pos;
+          state = State::CODE;
+          continue;
+        }
+
+        pos = NextOpener( text, pos );
+        if ( pos == text.size() )
+        {
+          break;
+        }
+
+        size_t end = pos;
+        switch ( text[ pos ] )
+        {
+          case '/':
+            if ( syntax_.c_comments && Next( text, pos ) == '*' )
+            {
+              state = State::C_COMMENT;
+              end = pos + 2;
+            }
+            else if ( syntax_.cpp_comments && Next( text, pos ) == '/' )
+            {
+              end = EndOfLine( text, pos );
+            }
+            break;
+
+          case '#':
+            end = EndOfLine( text, pos );
+            break;
+
+          case '\'':
+          case '"':
+          {
+            char quote = text[ pos ];
+            if ( syntax_.triple_quotes &&
+                 Next( text, pos ) == quote &&
+                 Next( text, pos + 1 ) == quote )
+            {
+              state = quote == '\'' ? State::TRIPLE_SINGLE_QUOTE
+                                    : State::TRIPLE_DOUBLE_QUOTE;
+              end = pos + 3;
+            }
+            else if ( quote == '\'' ? syntax_.single_quotes
+                                    : syntax_.double_quotes )
+            {
+              end = EndOfString( text, pos );
+            }
+            break;
+          }
+
+          case '`':
+            end = EndOfString( text, pos );
+            break;
+        }
+
+        if ( end == pos )
+        {
+          // Not actually the start of a comment or string.
+          ++pos;
+          continue;
+        }
+
+        if ( pos > code_start )
+        {
+          f( text.substr( code_start, pos - code_start ) );
+        }
+        pos = end;
+        code_start = end;
+      }
+
+      if ( state == State::CODE && text.size() > code_start )
+      {
+        f( text.substr( code_start ) );
+      }
+      return state;
+    }
+
+  private:
+    static constexpr char Next( std::string_view text, size_t pos )
+    {
+      return pos + 1 < text.size() ? text[ pos + 1 ] : '\0';
+    }
+
+    static size_t EndOfLine( std::string_view text, size_t pos )
+    {
+      auto end = text.find( '\n', pos );
+      return end == std::string_view::npos ? text.size() : end;
+    }
+
+    // Returns the position after the closing quote of the string starting at
+    // pos, or pos if it isn't one.
+    static size_t EndOfString( std::string_view text, size_t pos )
+    {
+      char quote = text[ pos ];
+      if ( pos > 0 && text[ pos - 1 ] == '\\' )
+      {
+        return pos;
+      }
+
+      for ( size_t i = pos + 1; i < text.size() && text[ i ] != '\n'; ++i )
+      {
+        if ( text[ i ] == '\\' &&
+             i + 1 < text.size() &&
+             ( text[ i + 1 ] == '\\' || text[ i + 1 ] == quote ) )
+        {
+          ++i;
+        }
+        else if ( text[ i ] == quote )
+        {
+          return i + 1;
+        }
+      }
+      return pos;
+    }
+
+    // Returns the position of the next byte which might start a comment or
+    // string, or text.size().
+    size_t NextOpener( std::string_view text, size_t pos ) const
+    {
+      while ( pos < text.size() )
+      {
+        uint64_t mask = ClassifyBlock( text.substr( pos ), openers_ );
+        while ( mask )
+        {
+          size_t offset = pos + static_cast< size_t >( std::countr_zero( mask ) );
+          // Non-ASCII bytes are always reported by the classifier.
+          if ( IsAscii( text[ offset ] ) )
+          {
+            return offset;
+          }
+          mask &= mask - 1;
+        }
+        pos += 64;
+      }
+      return text.size();
+    }
+
+    CommentAndStringSyntax syntax_;
+    AsciiByteSet openers_;
+  };
+}
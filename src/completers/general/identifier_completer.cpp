@@ -1,12 +1,25 @@
 #pragma once
 
 #include "core/IdentifierCompleter.h"
+#include "core/IdentifierUtils.h"
+#include "core/Repository.h"
+#include "core/Utils.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include "api.hpp"
 #include "ycmd.hpp"
+#include "buffer_token_index.cpp"
 #include "identifier_utils.cpp"
 #include "request_wrap.cpp"
+#include "worker_pool.cpp"
 
 namespace ycmd::completers::general {
   using namespace ycmd;
@@ -15,29 +28,382 @@ namespace ycmd::completers::general {
   {
     YouCompleteMe::IdentifierCompleter completer;
     const json& user_options;
+    WorkerPool& workers;
 
-    IdentifierCompleter( const json& user_options )
+    struct Buffer
+    {
+      std::string filetype;
+      BufferTokenIndex index;
+      // Set while a worker is updating the index. Other requests for the
+      // buffer in the meantime leave it alone; the next one catches up, as the
+      // index is always compared with the whole buffer.
+      bool updating = false;
+      bool unloaded = false;
+    };
+
+    // filepath -> identifier index for the buffer's contents when we last saw
+    // it
+    std::unordered_map<std::string, Buffer> buffers;
+
+    // Harvests which have been started and haven't finished yet. Their workers
+    // borrow candidates from the repository, so it mustn't be trimmed while
+    // there are any.
+    size_t harvests_in_progress = 0;
+
+    // tag file -> modification time when we last loaded it
+    std::unordered_map<std::string, std::filesystem::file_time_type>
+      tag_file_mtimes;
+
+    // Tag files are split into chunks of this many lines, so that a single
+    // large file is spread across the workers.
+    static constexpr size_t TAG_LINES_PER_CHUNK = 16384;
+
+    IdentifierCompleter( const json& user_options, WorkerPool& workers )
       : user_options( user_options )
-    {}
+      , workers( workers )
+    {
+      // Queries run on the I/O thread, which waits for them, so the database
+      // can't change under the workers.
+      size_t num_threads = default_worker_count();
+      completer.SetParallelFor(
+        [ &workers, num_threads ]( size_t num_tasks, const auto& task ) {
+          run_parallel( workers, num_threads, num_tasks, task );
+        },
+        num_threads );
+    }
+
+    struct BufferUpdate
+    {
+      Buffer* buffer;
+      std::string filepath;
+      std::string_view contents;
+      bool rebuild;
+      BufferTokenIndex::Diff diff;
+      // Whether the database has the change
+      bool applied = false;
+    };
+
+    // Claims the buffer's index, ready to bring it up to date with the file's
+    // contents, creating a new one if necessary. Returns nullopt if it's
+    // already being updated.
+    std::optional<BufferUpdate> start_buffer_update(
+      const std::string& filepath,
+      const api::SimpleRequest::FileData& file )
+    {
+      if ( file.filetypes.empty() )
+      {
+        return std::nullopt;
+      }
+      const auto& filetype = file.filetypes[ 0 ];
+
+      auto pos = buffers.find( filepath );
+      if ( pos != buffers.end() && pos->second.updating )
+      {
+        return std::nullopt;
+      }
+
+      bool rebuild = pos == buffers.end() || pos->second.filetype != filetype;
+      if ( rebuild )
+      {
+        bool collect_from_comments_and_strings = user_options.value(
+          "collect_identifiers_from_comments_and_strings", 0 ) != 0;
+        pos = buffers.insert_or_assign(
+          filepath,
+          Buffer{
+            filetype,
+            BufferTokenIndex(
+              IdentifierLexerForFiletype( filetype ),
+              collect_from_comments_and_strings
+                ? nullptr
+                : &CommentAndStringLexerForFiletype( filetype ) )
+          } ).first;
+      }
+
+      pos->second.updating = true;
+      pos->second.unloaded = false;
+      return BufferUpdate{
+        .buffer = &pos->second,
+        .filepath = filepath,
+        .contents = file.contents,
+        .rebuild = rebuild,
+      };
+    }
+
+    // Builds the candidates for new identifiers up front, which is most of
+    // the cost of adding them to the database. The repository can be used
+    // from any thread, so the database then only has to look them up.
+    static void intern_candidates(
+      const std::vector<std::string_view>& identifiers )
+    {
+      if ( !identifiers.empty() )
+      {
+        YouCompleteMe::Repository<YouCompleteMe::Candidate>::Instance()
+          .GetElements( identifiers );
+      }
+    }
+
+    // Only touches the buffer being updated, so can run on any thread.
+    static void run_buffer_update( BufferUpdate& update )
+    {
+      update.diff = update.buffer->index.Update( update.contents );
+      intern_candidates( update.rebuild ? update.buffer->index.Identifiers()
+                                        : update.diff.added );
+    }
+
+    // Applies the change in the buffer's identifiers to the database.
+    void finish_buffer_update( BufferUpdate& update )
+    {
+      auto& buffer = *update.buffer;
+      if ( update.rebuild )
+      {
+        completer.ClearForFileAndAddIdentifiersToDatabase(
+          buffer.index.Identifiers(),
+          buffer.filetype,
+          update.filepath );
+      }
+      else if ( !update.diff.added.empty() || !update.diff.removed.empty() )
+      {
+        completer.UpdateIdentifiersInDatabase( update.diff.added,
+                                               update.diff.removed,
+                                               buffer.filetype,
+                                               update.filepath );
+      }
+      update.applied = true;
+    }
+
+    // Gives the buffer back once its update is over, however it ended. An
+    // index whose change didn't reach the database is out of step with it, so
+    // is dropped to be rebuilt next time, as is one for a buffer which was
+    // unloaded meanwhile.
+    void release_buffer( BufferUpdate& update )
+    {
+      update.buffer->updating = false;
+      if ( !update.applied || update.buffer->unloaded )
+      {
+        buffers.erase( update.filepath );
+      }
+    }
+
+    // Releases the buffers of the updates when it goes out of scope.
+    struct BufferRelease
+    {
+      IdentifierCompleter& owner;
+      std::span<BufferUpdate> updates;
+
+      ~BufferRelease()
+      {
+        for ( auto& update : updates )
+        {
+          owner.release_buffer( update );
+        }
+      }
+    };
+
+    // Brings the index of the request's buffer up to date and applies the
+    // change in its identifiers to the database, on this thread. Only the lines
+    // which changed since the last request are lexed.
+    void update_buffer( const api::SimpleRequest& req )
+    {
+      auto update = start_buffer_update( req.filepath.string(),
+                                         req.file_data.at( req.filepath ) );
+      if ( update )
+      {
+        BufferRelease release{ *this, { &*update, 1 } };
+        run_buffer_update( *update );
+        finish_buffer_update( *update );
+      }
+    }
+
+    // Returns the tag files which have changed since we last loaded them, and
+    // notes their new modification times.
+    std::vector<std::filesystem::path> changed_tag_files(
+      const std::vector<std::string>& tag_files )
+    {
+      std::vector<std::filesystem::path> changed;
+      for ( const auto& tag_file : tag_files )
+      {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time( tag_file, ec );
+        if ( ec )
+        {
+          continue;
+        }
+        auto [ pos, inserted ] = tag_file_mtimes.try_emplace( tag_file, mtime );
+        if ( !inserted )
+        {
+          if ( mtime <= pos->second )
+          {
+            continue;
+          }
+          pos->second = mtime;
+        }
+        changed.emplace_back( tag_file );
+      }
+      return changed;
+    }
+
+    struct TagFile
+    {
+      std::filesystem::path path;
+      std::vector<std::string> lines;
+    };
+
+    struct TagChunk
+    {
+      const TagFile* file;
+      size_t first;
+      size_t last;
+      YouCompleteMe::FiletypeIdentifierMap identifiers;
+    };
+
+    // Lexes all of the buffers in the request, and any tag files which have
+    // changed, on the workers. The results are all applied to the database
+    // together once they are done, so that the database is only touched on
+    // this thread.
+    Async<void> harvest_identifiers(
+      const requests::EventNotification& req )
+    {
+      // Counts this harvest until it returns or throws.
+      struct InProgress
+      {
+        size_t& count;
+        explicit InProgress( size_t& count ) : count( count ) { ++count; }
+        ~InProgress() { --count; }
+      } in_progress( harvests_in_progress );
+
+      std::vector<BufferUpdate> updates;
+      updates.reserve( req.file_data.size() );
+      for ( const auto& [ filepath, file ] : req.file_data )
+      {
+        if ( auto update = start_buffer_update( filepath.string(), file ) )
+        {
+          updates.push_back( std::move( *update ) );
+        }
+      }
+      BufferRelease release{ *this, updates };
+
+      std::vector<TagFile> tag_files;
+      if ( user_options.value( "collect_identifiers_from_tags_files", 0 ) )
+      {
+        for ( auto& path : changed_tag_files( req.tag_files ) )
+        {
+          tag_files.push_back( { std::move( path ), {} } );
+        }
+      }
+
+      co_await parallel_for_each( workers, tag_files, []( TagFile& tag_file ) {
+        try
+        {
+          tag_file.lines = YouCompleteMe::ReadUtf8File( tag_file.path );
+        }
+        catch ( ... )
+        {
+          // Treated as empty, like ExtractIdentifiersFromTagsFile
+        }
+      } );
+
+      std::vector<TagChunk> tag_chunks;
+      for ( const auto& tag_file : tag_files )
+      {
+        for ( size_t first = 0;
+              first < tag_file.lines.size();
+              first += TAG_LINES_PER_CHUNK )
+        {
+          tag_chunks.push_back( {
+            .file = &tag_file,
+            .first = first,
+            .last = std::min( first + TAG_LINES_PER_CHUNK,
+                              tag_file.lines.size() ),
+          } );
+        }
+      }
+
+      // Everything is independent, so it can all go at once.
+      std::vector<std::function<void()>> tasks;
+      tasks.reserve( updates.size() + tag_chunks.size() );
+      for ( auto& update : updates )
+      {
+        tasks.emplace_back( [ &update ]() { run_buffer_update( update ); } );
+      }
+      for ( auto& chunk : tag_chunks )
+      {
+        tasks.emplace_back( [ &chunk ]() {
+          const auto& lines = chunk.file->lines;
+          chunk.identifiers = YouCompleteMe::ExtractIdentifiersFromTagLines(
+            lines.begin() + chunk.first,
+            lines.begin() + chunk.last,
+            chunk.file->path );
+
+          std::vector<std::string_view> identifiers;
+          for ( const auto& [ filetype, files ] : chunk.identifiers )
+          {
+            for ( const auto& [ filepath, file_identifiers ] : files )
+            {
+              identifiers.insert( identifiers.end(),
+                                  file_identifiers.begin(),
+                                  file_identifiers.end() );
+            }
+          }
+          intern_candidates( identifiers );
+        } );
+      }
+
+      co_await parallel_for_each( workers,
+                                  tasks,
+                                  []( std::function<void()>& task ) {
+                                    task();
+                                  } );
+
+      // A file's tags can be spread over several chunks (and tag files), so
+      // they have to be put together before replacing what the database has
+      // for it.
+      YouCompleteMe::FiletypeIdentifierMap tag_identifiers;
+      for ( auto& chunk : tag_chunks )
+      {
+        for ( auto& [ filetype, files ] : chunk.identifiers )
+        {
+          auto& merged_files = tag_identifiers[ filetype ];
+          for ( auto& [ filepath, identifiers ] : files )
+          {
+            auto& merged = merged_files[ filepath ];
+            if ( merged.empty() )
+            {
+              merged = std::move( identifiers );
+            }
+            else
+            {
+              merged.insert( merged.end(),
+                             std::make_move_iterator( identifiers.begin() ),
+                             std::make_move_iterator( identifiers.end() ) );
+            }
+          }
+        }
+      }
+
+      // Nothing else can run on this thread until we're done here, so
+      // requests see either none or all of the changes.
+      for ( auto& update : updates )
+      {
+        finish_buffer_update( update );
+      }
+      if ( !tag_identifiers.empty() )
+      {
+        completer.AddIdentifiersToDatabaseFromTagFiles(
+          std::move( tag_identifiers ) );
+      }
+    }
 
     Async<void> handle_event_notification(
       const RequestWrapper<requests::EventNotification>& request_data )
     {
-      const auto& file = request_data.req.file_data.at(
-        request_data.req.filepath );
-
       using enum requests::EventNotification::Event;
       switch ( request_data.req.event_name )
       {
         case FileReadyToParse:
         {
-          completer.ClearForFileAndAddIdentifiersToDatabase(
-            IdentifiersFromBuffer( file ),
-            file.filetypes[ 0 ],
-            request_data.req.filepath.string() );
+          co_await harvest_identifiers( request_data.req );
           break;
 
-          // TODO: AddIdentifiersFromTagFiles
           // TODO: AddIdentifiersFromSyntax
         }
         case FileSave:
@@ -45,18 +411,30 @@ namespace ycmd::completers::general {
         case BufferVisit:
           break;
         case BufferUnload:
+        {
+          // The identifiers stay in the database, but there's no point keeping
+          // the index for a buffer which is gone.
+          auto pos = buffers.find( request_data.req.filepath.string() );
+          if ( pos != buffers.end() )
+          {
+            if ( pos->second.updating )
+            {
+              pos->second.unloaded = true;
+            }
+            else
+            {
+              buffers.erase( pos );
+            }
+          }
           break;
+        }
         case InsertLeave:
-          completer.AddSingleIdentifierToDatabase(
-            IdentifierUnderCursor( request_data.req ),
-            file.filetypes[ 0 ],
-            request_data.req.filepath.string() );
-          break;
         case CurrentIdentifierFinished:
-          completer.AddSingleIdentifierToDatabase(
-            IdentifierBeforeCursor( request_data.req ),
-            file.filetypes[ 0 ],
-            request_data.req.filepath.string() );
+          // Python ycmd adds just the identifier under (or before) the cursor
+          // here, to avoid re-lexing the whole buffer. Updating the index is
+          // cheap, and picks up that identifier along with anything else which
+          // changed.
+          update_buffer( request_data.req );
           break;
       }
 
@@ -66,9 +444,13 @@ namespace ycmd::completers::general {
     Async<std::vector<api::Candidate>> compute_candiatdes(
       const ycmd::RequestWrap& request_wrap )
     {
+      // Only the best are ranked in full, so the fewer the cheaper.
+      size_t max_candidates = static_cast<size_t>( std::max(
+        user_options.value( "max_num_identifier_candidates", 0 ), 0 ) );
       auto completions = completer.CandidatesForQueryAndType(
             request_wrap.query_bytes(), // utf-8, as required by this lib
-            request_wrap.first_filetype() );
+            request_wrap.first_filetype(),
+            max_candidates );
 
       std::vector<api::Candidate> candidates;
       candidates.reserve( completions.size() );
@@ -17,12 +17,33 @@
 
 #include "Candidate.h"
 #include "Result.h"
+#include "Utils.h"
 
 namespace YouCompleteMe {
 
 void Candidate::ComputeCaseSwappedText() {
-  for ( const auto &character : Characters() ) {
-    case_swapped_text_.append( character->SwappedCase() );
+  // Only ASCII letters have a case to swap in ASCII text.
+  if ( IsAscii( Text() ) ) {
+    case_swapped_text_ = Text();
+    for ( auto &byte : case_swapped_text_ ) {
+      auto lowercase = static_cast< uint8_t >(
+        Lowercase( static_cast< uint8_t >( byte ) ) );
+      if ( 'a' <= lowercase && lowercase <= 'z' ) {
+        byte ^= 0x20;
+      }
+    }
+  } else {
+    for ( const auto &character : Characters() ) {
+      case_swapped_text_.append( character->SwappedCase() );
+    }
+  }
+
+  for ( size_t i = 0; i < sizeof( uint64_t ); ++i ) {
+    case_swapped_text_prefix_ <<= 8;
+    if ( i < case_swapped_text_.size() ) {
+      case_swapped_text_prefix_ |= static_cast< uint8_t >(
+        case_swapped_text_[ i ] );
+    }
   }
 }
 
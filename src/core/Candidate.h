@@ -32,11 +32,8 @@ public:
 
   YCM_EXPORT explicit Candidate( std::string&& text );
   // Make class noncopyable
-private:
-  Candidate( const Candidate& ) = default;
-  Candidate& operator=( const Candidate& ) = default;
-public:
-  Candidate clone() const { return *this; }
+  Candidate( const Candidate& ) = delete;
+  Candidate& operator=( const Candidate& ) = delete;
   Candidate( Candidate&& ) = default;
   Candidate& operator=( Candidate&& ) = default;
   ~Candidate() = default;
@@ -45,6 +42,13 @@ public:
     return case_swapped_text_;
   }
 
+  // The first 8 bytes of CaseSwappedText(), padded with zeros, most
+  // significant first, so that comparing two prefixes compares the start of the
+  // texts.
+  inline uint64_t CaseSwappedTextPrefix() const {
+    return case_swapped_text_prefix_;
+  }
+
   inline const CharacterSequence &WordBoundaryChars() const {
     return word_boundary_chars_;
   }
@@ -61,6 +65,7 @@ private:
   void ComputeWordBoundaryChars();
 
   std::string case_swapped_text_;
+  uint64_t case_swapped_text_prefix_ = 0;
   CharacterSequence word_boundary_chars_;
   bool text_is_lowercase_;
 };
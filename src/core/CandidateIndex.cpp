@@ -0,0 +1,360 @@
+// Copyright (C) 2021 ycmd contributors
+//
+// This file is part of ycmd.
+//
+// ycmd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ycmd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "CandidateIndex.h"
+
+#include "Candidate.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#include <immintrin.h>
+#define YCM_PREFILTER_X86 1
+#endif
+
+namespace YouCompleteMe {
+
+namespace {
+
+// Writes the positions of the candidates in the blocks [ first_block,
+// last_block ) which contain all of the query's bytes (as a mask) and are at
+// least as long, and returns the end of what it wrote.
+template< typename Block, typename Lengths >
+using PrefilterFunction = uint32_t* (*)( const Block* blocks,
+                                         const Lengths* lengths,
+                                         size_t first_block,
+                                         size_t last_block,
+                                         uint64_t query_mask,
+                                         uint8_t query_length,
+                                         uint32_t* positions );
+
+template< typename Block, typename Lengths >
+uint32_t* PrefilterScalar( const Block* blocks,
+                           const Lengths* lengths,
+                           size_t first_block,
+                           size_t last_block,
+                           uint64_t query_mask,
+                           uint8_t query_length,
+                           uint32_t* positions ) {
+  for ( size_t block = first_block; block < last_block; ++block ) {
+    for ( size_t i = 0; i < std::size( lengths[ block ] ); ++i ) {
+      if ( ( blocks[ block ].masks[ i ] & query_mask ) == query_mask &&
+           lengths[ block ][ i ] >= query_length ) {
+        *positions++ = static_cast< uint32_t >(
+          block * std::size( lengths[ block ] ) + i );
+      }
+    }
+  }
+  return positions;
+}
+
+#ifdef YCM_PREFILTER_X86
+
+// Bit i is set for each of the 8 lengths which is at least the query's.
+inline uint32_t LongEnough( const void* lengths, __m128i query_length ) {
+  __m128i block = _mm_loadl_epi64( static_cast< const __m128i* >( lengths ) );
+  return static_cast< uint32_t >( _mm_movemask_epi8(
+    _mm_cmpeq_epi8( _mm_max_epu8( block, query_length ), block ) ) ) & 0xff;
+}
+
+
+inline uint32_t* WritePositions( uint32_t accepted,
+                                 size_t first,
+                                 uint32_t* positions ) {
+  while ( accepted ) {
+    *positions++ = static_cast< uint32_t >( first +
+                                            std::countr_zero( accepted ) );
+    accepted &= accepted - 1;
+  }
+  return positions;
+}
+
+
+// SSE2 is always there on x86-64, but has no 64-bit compare, so a mask is
+// accepted when both of its 32-bit halves have nothing the query needs missing.
+template< typename Block, typename Lengths >
+uint32_t* PrefilterSse2( const Block* blocks,
+                         const Lengths* lengths,
+                         size_t first_block,
+                         size_t last_block,
+                         uint64_t query_mask,
+                         uint8_t query_length,
+                         uint32_t* positions ) {
+  const __m128i query = _mm_set1_epi64x( static_cast< int64_t >( query_mask ) );
+  const __m128i length = _mm_set1_epi8( static_cast< char >( query_length ) );
+  const __m128i zero = _mm_setzero_si128();
+  for ( size_t block = first_block; block < last_block; ++block ) {
+    uint32_t contains = 0;
+    for ( size_t i = 0; i < 4; ++i ) {
+      __m128i masks = _mm_load_si128(
+        reinterpret_cast< const __m128i* >( blocks[ block ].masks.data() ) + i );
+      __m128i missing = _mm_cmpeq_epi32( _mm_andnot_si128( masks, query ),
+                                         zero );
+      missing = _mm_and_si128(
+        missing, _mm_shuffle_epi32( missing, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+      contains |= static_cast< uint32_t >(
+        _mm_movemask_pd( _mm_castsi128_pd( missing ) ) ) << ( i * 2 );
+    }
+    positions = WritePositions(
+      contains & LongEnough( lengths[ block ].data(), length ),
+      block * std::size( lengths[ block ] ),
+      positions );
+  }
+  return positions;
+}
+
+
+template< typename Block, typename Lengths >
+__attribute__(( target( "avx2" ) ))
+uint32_t* PrefilterAvx2( const Block* blocks,
+                         const Lengths* lengths,
+                         size_t first_block,
+                         size_t last_block,
+                         uint64_t query_mask,
+                         uint8_t query_length,
+                         uint32_t* positions ) {
+  const __m256i query = _mm256_set1_epi64x(
+    static_cast< int64_t >( query_mask ) );
+  const __m128i length = _mm_set1_epi8( static_cast< char >( query_length ) );
+  const __m256i zero = _mm256_setzero_si256();
+  for ( size_t block = first_block; block < last_block; ++block ) {
+    const __m256i* masks =
+      reinterpret_cast< const __m256i* >( blocks[ block ].masks.data() );
+    __m256i low = _mm256_cmpeq_epi64(
+      _mm256_andnot_si256( _mm256_load_si256( masks ), query ), zero );
+    __m256i high = _mm256_cmpeq_epi64(
+      _mm256_andnot_si256( _mm256_load_si256( masks + 1 ), query ), zero );
+    uint32_t contains = static_cast< uint32_t >(
+      _mm256_movemask_pd( _mm256_castsi256_pd( low ) ) |
+      ( _mm256_movemask_pd( _mm256_castsi256_pd( high ) ) << 4 ) );
+    positions = WritePositions(
+      contains & LongEnough( lengths[ block ].data(), length ),
+      block * std::size( lengths[ block ] ),
+      positions );
+  }
+  return positions;
+}
+
+#endif // YCM_PREFILTER_X86
+
+
+template< typename Block, typename Lengths >
+PrefilterFunction< Block, Lengths > SelectPrefilter() {
+#ifdef YCM_PREFILTER_X86
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    return &PrefilterAvx2< Block, Lengths >;
+  }
+  return &PrefilterSse2< Block, Lengths >;
+#else
+  return &PrefilterScalar< Block, Lengths >;
+#endif
+}
+
+
+uint8_t PrefilterLength( const Candidate* candidate ) {
+  return static_cast< uint8_t >( std::min< size_t >( candidate->Length(),
+                                                     255 ) );
+}
+
+// Below this, the delta is merged into the base only once it is a quarter of
+// the size of the base, so each candidate is copied a constant number of times
+// on average.
+constexpr size_t MIN_MERGE_SIZE = 1024;
+
+} // unnamed namespace
+
+
+void CandidateIndex::Add( Candidates candidates ) {
+  for ( const Candidate* candidate : candidates ) {
+    auto [ it, inserted ] = members_.try_emplace( candidate );
+    Membership &membership = it->second;
+    if ( inserted ) {
+      AddToDelta( candidate, membership );
+    } else if ( membership.occurrences == 0 ) {
+      // Only candidates in the base are kept with no occurrences. This may be
+      // a new candidate at a gone one's address, so its prefilter is reset.
+      base_present_[ membership.position ] = true;
+      SetPrefilter( membership.position, candidate );
+      --num_gone_from_base_;
+    }
+    ++membership.occurrences;
+  }
+  MaybeMerge();
+}
+
+
+void CandidateIndex::Remove( Candidates candidates ) {
+  for ( const Candidate* candidate : candidates ) {
+    auto it = members_.find( candidate );
+    if ( it == members_.end() || it->second.occurrences == 0 ) {
+      continue;
+    }
+    Membership &membership = it->second;
+    if ( --membership.occurrences > 0 ) {
+      continue;
+    }
+    if ( membership.position < base_.size() ) {
+      base_present_[ membership.position ] = false;
+      SetPrefilter( membership.position, nullptr );
+      ++num_gone_from_base_;
+    } else {
+      RemoveFromDelta( membership );
+      members_.erase( it );
+    }
+  }
+  MaybeMerge();
+}
+
+
+void CandidateIndex::AddToDelta( const Candidate* candidate,
+                                 Membership &membership ) {
+  membership.position = static_cast< uint32_t >( base_.size() +
+                                                 delta_.size() );
+  delta_.push_back( candidate );
+  delta_masks_.push_back( candidate->BytesPresentMask() );
+  delta_lengths_.push_back( PrefilterLength( candidate ) );
+}
+
+
+// Moves the last candidate of the delta into the removed one's place.
+void CandidateIndex::RemoveFromDelta( Membership &membership ) {
+  size_t index = membership.position - base_.size();
+  const Candidate* last = delta_.back();
+  if ( index + 1 < delta_.size() ) {
+    delta_[ index ] = last;
+    delta_masks_[ index ] = delta_masks_.back();
+    delta_lengths_[ index ] = delta_lengths_.back();
+    members_.find( last )->second.position = membership.position;
+  }
+  delta_.pop_back();
+  delta_masks_.pop_back();
+  delta_lengths_.pop_back();
+}
+
+
+bool CandidateIndex::PossibleMatch( const Candidate &candidate,
+                                    const Word &query ) {
+  return !candidate.IsEmpty() &&
+         candidate.Length() >= query.Length() &&
+         candidate.ContainsBytes( query );
+}
+
+
+CandidateIndex::PrefilterQuery CandidateIndex::MakePrefilterQuery(
+  const Word &query ) {
+  // Empty candidates have no length, and are never matched.
+  return { query.BytesPresentMask(),
+           static_cast< uint8_t >(
+             std::clamp< size_t >( query.Length(), 1, 255 ) ) };
+}
+
+
+std::span< const uint32_t > CandidateIndex::Prefilter( const Word &query,
+                                                      size_t first,
+                                                      size_t last ) const {
+  static const auto prefilter = SelectPrefilter< PrefilterBlock,
+                                                 PrefilterLengths >();
+  // Each thread which scans a part of the index has a buffer of its own.
+  thread_local std::vector< uint32_t > positions;
+  last = std::min( last, NumPositions() );
+  if ( first >= last ) {
+    return {};
+  }
+  // Whole blocks of the base are scanned, so a few positions before first and
+  // after last can pass too; they are cut off at the end.
+  positions.resize( last - first + 2 * BLOCK_SIZE );
+  auto [ query_mask, query_length ] = MakePrefilterQuery( query );
+  uint32_t* end = positions.data();
+  size_t base_last = std::min( last, base_.size() );
+  if ( first < base_last ) {
+    end = prefilter( prefilter_masks_.data(),
+                     prefilter_lengths_.data(),
+                     first / BLOCK_SIZE,
+                     ( base_last + BLOCK_SIZE - 1 ) / BLOCK_SIZE,
+                     query_mask,
+                     query_length,
+                     end );
+  }
+  for ( size_t position = std::max( first, base_.size() ); position < last;
+        ++position ) {
+    size_t i = position - base_.size();
+    if ( ( delta_masks_[ i ] & query_mask ) == query_mask &&
+         delta_lengths_[ i ] >= query_length ) {
+      *end++ = static_cast< uint32_t >( position );
+    }
+  }
+
+  auto begin = std::lower_bound( positions.data(), end, first );
+  end = std::lower_bound( begin, end, last );
+  return { begin, end };
+}
+
+
+// Gone candidates are given no length, so that nothing matches them.
+void CandidateIndex::SetPrefilter( size_t position,
+                                   const Candidate* candidate ) {
+  if ( candidate ) {
+    prefilter_masks_[ position / BLOCK_SIZE ].masks[ position % BLOCK_SIZE ] =
+      candidate->BytesPresentMask();
+  }
+  prefilter_lengths_[ position / BLOCK_SIZE ][ position % BLOCK_SIZE ] =
+    candidate ? PrefilterLength( candidate ) : 0;
+}
+
+
+void CandidateIndex::MaybeMerge() {
+  size_t changes = delta_.size() + num_gone_from_base_;
+  if ( changes > std::max( MIN_MERGE_SIZE, base_.size() / 4 ) ) {
+    Merge();
+  }
+}
+
+
+void CandidateIndex::Merge() {
+  std::vector< const Candidate* > merged;
+  merged.reserve( Size() );
+  for ( size_t i = 0; i < base_.size(); ++i ) {
+    if ( base_present_[ i ] ) {
+      merged.push_back( base_[ i ] );
+    } else {
+      members_.erase( base_[ i ] );
+    }
+  }
+  merged.insert( merged.end(), delta_.begin(), delta_.end() );
+
+  for ( size_t i = 0; i < merged.size(); ++i ) {
+    members_.find( merged[ i ] )->second.position =
+      static_cast< uint32_t >( i );
+  }
+
+  base_ = std::move( merged );
+  base_present_.assign( base_.size(), true );
+
+  size_t num_blocks = ( base_.size() + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+  prefilter_masks_.assign( num_blocks, PrefilterBlock{} );
+  prefilter_lengths_.assign( num_blocks, PrefilterLengths{} );
+  for ( size_t i = 0; i < base_.size(); ++i ) {
+    SetPrefilter( i, base_[ i ] );
+  }
+  num_gone_from_base_ = 0;
+  delta_.clear();
+  delta_masks_.clear();
+  delta_lengths_.clear();
+}
+
+} // namespace YouCompleteMe
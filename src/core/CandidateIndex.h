@@ -0,0 +1,239 @@
+// Copyright (C) 2021 ycmd contributors
+//
+// This file is part of ycmd.
+//
+// ycmd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ycmd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CANDIDATEINDEX_H_W7RK2JQD
+#define CANDIDATEINDEX_H_W7RK2JQD
+
+#ifdef YCM_ABSEIL_SUPPORTED
+#include <absl/container/flat_hash_map.h>
+#else
+#include <unordered_map>
+#endif
+#include <array>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace YouCompleteMe {
+
+class Candidate;
+class Word;
+
+// The candidates of all of the files of one filetype, each of them once, so
+// that a query can scan them without deduplicating them itself.
+//
+// Changes go to a small delta, and are merged into a contiguous base once the
+// delta gets big compared with it, like a log-structured merge tree. The base
+// is never changed in between; a candidate which leaves it is only marked as
+// gone, and dropped at the next merge. So adding and removing candidates is
+// cheap, and the base keeps the order the candidates were added in, which is
+// also (roughly) their order in the repository's arena.
+//
+// Each candidate's byte mask and length are also kept in arrays of their own
+// (see PrefilterBlock), so that a query can reject most of them without
+// touching the candidates themselves; for the base, several at a time with
+// SIMD.
+//
+// A candidate which is marked as gone isn't used again, so it may since have
+// been trimmed from the repository. If the repository then builds a new
+// candidate at the same address and it's added here, it simply takes the old
+// one's place.
+//
+// This class is not thread-safe.
+class CandidateIndex {
+public:
+  using Candidates = std::span< const Candidate* const >;
+
+  CandidateIndex() = default;
+  CandidateIndex( const CandidateIndex& ) = delete;
+  CandidateIndex& operator=( const CandidateIndex& ) = delete;
+  CandidateIndex( CandidateIndex&& ) = default;
+  CandidateIndex& operator=( CandidateIndex&& ) = default;
+
+  // Counts an occurrence of each of the candidates, in some file. A candidate
+  // stays in the index until all of its occurrences have been removed.
+  YCM_EXPORT void Add( Candidates candidates );
+  YCM_EXPORT void Remove( Candidates candidates );
+
+  // Calls f( candidate ) for each candidate in the index, once.
+  template< typename F >
+  void ForEach( F&& f ) const {
+    for ( size_t i = 0; i < base_.size(); ++i ) {
+      if ( base_present_[ i ] ) {
+        f( base_[ i ] );
+      }
+    }
+    for ( const Candidate* candidate : delta_ ) {
+      f( candidate );
+    }
+  }
+
+  // Calls f( candidate ) for each candidate in the index which could match the
+  // query: it contains the query's bytes and is at least as long. That still
+  // has to be checked with Candidate::QueryMatchResult. If f takes a position
+  // too, it's called as f( position, candidate ) instead.
+  template< typename F >
+  void ForEachPossibleMatch( const Word &query, F&& f ) const {
+    ForEachPossibleMatch( query, 0, NumPositions(), std::forward< F >( f ) );
+  }
+
+  // Same as above, for the candidates at the positions [ first, last ) of the
+  // index. Positions go from 0 to NumPositions(), so that the index can be
+  // split into ranges which are scanned separately (e.g. on several threads).
+  template< typename F >
+  void ForEachPossibleMatch( const Word &query,
+                             size_t first,
+                             size_t last,
+                             F&& f ) const {
+    for ( uint32_t position : Prefilter( query, first, last ) ) {
+      CallIfPossibleMatch( query, position, f );
+    }
+  }
+
+  // Same as above, for the candidates at the given positions only, e.g. those
+  // which matched a previous query. The positions are only valid until the
+  // index changes.
+  template< typename F >
+  void ForEachPossibleMatch( const Word &query,
+                             std::span< const uint32_t > positions,
+                             F&& f ) const {
+    PrefilterQuery prefilter_query = MakePrefilterQuery( query );
+    for ( uint32_t position : positions ) {
+      if ( PassesPrefilter( prefilter_query, position ) ) {
+        CallIfPossibleMatch( query, position, f );
+      }
+    }
+  }
+
+  // The positions of the candidates in the index, including those which are
+  // gone from the base.
+  size_t NumPositions() const {
+    return base_.size() + delta_.size();
+  }
+
+  size_t Size() const {
+    return base_.size() - num_gone_from_base_ + delta_.size();
+  }
+
+  // How many candidates are (or were) in the base and the delta, for tests.
+  size_t BaseSize() const {
+    return base_.size();
+  }
+
+  size_t DeltaSize() const {
+    return delta_.size();
+  }
+
+private:
+  struct Membership {
+    // Occurrences of the candidate in the files
+    uint32_t occurrences = 0;
+    // Index into the base, or into the delta after the base's size
+    uint32_t position = 0;
+  };
+
+  // The byte masks (see Word::BytesPresentMask) and lengths of 8 candidates of
+  // the base, in a cache line of their own. Lengths are capped at 255, and are
+  // zero for empty candidates and for candidates which are gone from the base,
+  // which no query matches.
+  static constexpr size_t BLOCK_SIZE = 8;
+  struct alignas( 64 ) PrefilterBlock {
+    std::array< uint64_t, BLOCK_SIZE > masks;
+  };
+  using PrefilterLengths = std::array< uint8_t, BLOCK_SIZE >;
+
+  // Returns the positions in [ first, last ) of the candidates which pass the
+  // prefilter, in order, in a buffer which is reused by the next call on this
+  // thread.
+  YCM_EXPORT std::span< const uint32_t > Prefilter( const Word &query,
+                                                    size_t first,
+                                                    size_t last ) const;
+  YCM_EXPORT static bool PossibleMatch( const Candidate &candidate,
+                                        const Word &query );
+
+  template< typename F >
+  void CallIfPossibleMatch( const Word &query,
+                            uint32_t position,
+                            F &f ) const {
+    const Candidate* candidate = position < base_.size()
+                                 ? base_[ position ]
+                                 : delta_[ position - base_.size() ];
+    if ( PossibleMatch( *candidate, query ) ) {
+      if constexpr ( std::is_invocable_v< F&, uint32_t, const Candidate* > ) {
+        f( position, candidate );
+      } else {
+        f( candidate );
+      }
+    }
+  }
+
+  // What the prefilter compares the candidates' masks and lengths with
+  struct PrefilterQuery {
+    uint64_t mask;
+    uint8_t length;
+  };
+
+  YCM_EXPORT static PrefilterQuery MakePrefilterQuery( const Word &query );
+
+  bool PassesPrefilter( const PrefilterQuery &query, size_t position ) const {
+    uint64_t mask;
+    uint8_t length;
+    if ( position < base_.size() ) {
+      mask = prefilter_masks_[ position / BLOCK_SIZE ]
+               .masks[ position % BLOCK_SIZE ];
+      length = prefilter_lengths_[ position / BLOCK_SIZE ]
+                 [ position % BLOCK_SIZE ];
+    } else {
+      mask = delta_masks_[ position - base_.size() ];
+      length = delta_lengths_[ position - base_.size() ];
+    }
+    return ( mask & query.mask ) == query.mask && length >= query.length;
+  }
+
+  void AddToDelta( const Candidate* candidate, Membership &membership );
+  void RemoveFromDelta( Membership &membership );
+  void SetPrefilter( size_t position, const Candidate* candidate );
+  void MaybeMerge();
+  void Merge();
+
+#ifdef YCM_ABSEIL_SUPPORTED
+  using MembershipMap = absl::flat_hash_map< const Candidate*, Membership >;
+#else
+  using MembershipMap = std::unordered_map< const Candidate*, Membership >;
+#endif
+
+  // Every candidate in the base and the delta
+  MembershipMap members_;
+  std::vector< const Candidate* > base_;
+  // Whether each candidate in the base is still in the index
+  std::vector< uint8_t > base_present_;
+  size_t num_gone_from_base_ = 0;
+  // The base's masks and lengths, a block for every ( up to ) 8 candidates
+  std::vector< PrefilterBlock > prefilter_masks_;
+  std::vector< PrefilterLengths > prefilter_lengths_;
+  // Candidates which aren't in the base, in the order they were added, and
+  // their masks and lengths
+  std::vector< const Candidate* > delta_;
+  std::vector< uint64_t > delta_masks_;
+  std::vector< uint8_t > delta_lengths_;
+};
+
+} // namespace YouCompleteMe
+
+#endif /* end of include guard: CANDIDATEINDEX_H_W7RK2JQD */
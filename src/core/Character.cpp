@@ -19,7 +19,13 @@
 #include "CodePoint.h"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
 
 namespace YouCompleteMe {
 
@@ -70,6 +76,77 @@ CodePointSequence CanonicalDecompose( std::string_view text ) {
   return CanonicalSort( BreakIntoCodePoints( text ) );
 }
 
+
+// Gives each distinct string an ID, for the lifetime of the process, and looks
+// strings up by their IDs. The strings are kept in segments which double in
+// size and never move, so looking one up needs no lock: the string for an ID
+// is stored before the ID is handed out, and whoever hands a character to
+// another thread makes what it was built from visible along with it.
+class StringTable {
+public:
+  uint32_t Intern( const std::string &text ) {
+    std::lock_guard locker( mutex_ );
+    auto it = ids_.find( text );
+    if ( it != ids_.end() ) {
+      return it->second;
+    }
+
+    auto id = static_cast< uint32_t >( ids_.size() );
+    auto [ segment, index ] = Locate( id );
+    if ( !segments_[ segment ] ) {
+      segments_[ segment ] = std::make_unique< std::string[] >(
+        FIRST_SEGMENT_SIZE << segment );
+    }
+    std::string &stored = segments_[ segment ][ index ];
+    stored = text;
+    ids_.emplace( stored, id );
+    return id;
+  }
+
+  const std::string &Get( uint32_t id ) const {
+    auto [ segment, index ] = Locate( id );
+    return segments_[ segment ][ index ];
+  }
+
+private:
+  static std::pair< size_t, size_t > Locate( uint32_t id ) {
+    uint64_t position = uint64_t{ id } + FIRST_SEGMENT_SIZE;
+    size_t segment = static_cast< size_t >(
+      std::bit_width( position ) - std::bit_width( FIRST_SEGMENT_SIZE ) );
+    return { segment, position - ( FIRST_SEGMENT_SIZE << segment ) };
+  }
+
+  static constexpr uint64_t FIRST_SEGMENT_SIZE = 64;
+
+  // Enough segments for every 32-bit ID
+  std::array< std::unique_ptr< std::string[] >, 27 > segments_;
+  // Views into the segments
+  std::unordered_map< std::string_view, uint32_t > ids_;
+  std::mutex mutex_;
+};
+
+
+StringTable &Strings() {
+  static StringTable strings;
+  return strings;
+}
+
+
+// Characters with IDs which are too big to fit can't be packed.
+uint64_t Pack( uint32_t normal,
+               uint32_t base,
+               uint32_t folded_case,
+               bool is_uppercase ) {
+  if ( std::max( { normal, base, folded_case } ) >
+       Character::PACKED_ID_MASK ) {
+    return Character::NOT_PACKED;
+  }
+  return uint64_t{ normal } |
+         uint64_t{ base } << Character::PACKED_ID_BITS |
+         uint64_t{ folded_case } << ( 2 * Character::PACKED_ID_BITS ) |
+         ( is_uppercase ? Character::PACKED_UPPERCASE : 0 );
+}
+
 } // unnamed namespace
 
 Character::Character( std::string_view character )
@@ -81,10 +158,14 @@ Character::Character( std::string_view character )
   // https://www.unicode.org/versions/Unicode13.0.0/ch03.pdf#G49621
   CodePointSequence code_points = CanonicalDecompose( character );
 
+  std::string normal;
+  std::string base;
+  std::string folded_case;
+  std::string swapped_case;
   for ( const auto &code_point : code_points ) {
-    normal_.append( code_point->Normal() );
-    folded_case_.append( code_point->FoldedCase() );
-    swapped_case_.append( code_point->SwappedCase() );
+    normal.append( code_point->Normal() );
+    folded_case.append( code_point->FoldedCase() );
+    swapped_case.append( code_point->SwappedCase() );
     is_letter_ |= code_point->IsLetter();
     is_punctuation_ |= code_point->IsPunctuation();
     is_uppercase_ |= code_point->IsUppercase();
@@ -96,9 +177,36 @@ Character::Character( std::string_view character )
         is_base_ = false;
         break;
       default:
-        base_.append( code_point->FoldedCase() );
+        base.append( code_point->FoldedCase() );
     }
   }
+
+  StringTable &strings = Strings();
+  normal_ = strings.Intern( normal );
+  base_ = strings.Intern( base );
+  folded_case_ = strings.Intern( folded_case );
+  swapped_case_ = strings.Intern( swapped_case );
+  packed_ = Pack( normal_, base_, folded_case_, is_uppercase_ );
+}
+
+
+const std::string &Character::Normal() const {
+  return Strings().Get( normal_ );
+}
+
+
+const std::string &Character::Base() const {
+  return Strings().Get( base_ );
+}
+
+
+const std::string &Character::FoldedCase() const {
+  return Strings().Get( folded_case_ );
+}
+
+
+const std::string &Character::SwappedCase() const {
+  return Strings().Get( swapped_case_ );
 }
 
 
@@ -18,6 +18,7 @@
 #ifndef CHARACTER_H_YTIET2HZ
 #define CHARACTER_H_YTIET2HZ
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -31,6 +32,10 @@ namespace YouCompleteMe {
 // compute the folded and swapped case versions of the normalized character. It
 // also holds some properties like if the character is a letter or a
 // punctuation, and if it is uppercase.
+//
+// The versions of the character are interned: it only holds their IDs, which
+// are the same for equal strings, so comparing characters is comparing
+// integers. The strings themselves are shared by all of the characters.
 class Character {
 public:
   YCM_EXPORT explicit Character( std::string_view character );
@@ -40,21 +45,10 @@ public:
   Character( Character&& ) = default;
   Character& operator=( Character&& ) = default;
 
-  inline const std::string &Normal() const {
-    return normal_;
-  }
-
-  inline const std::string &Base() const {
-    return base_;
-  }
-
-  inline const std::string &FoldedCase() const {
-    return folded_case_;
-  }
-
-  inline const std::string &SwappedCase() const {
-    return swapped_case_;
-  }
+  YCM_EXPORT const std::string &Normal() const;
+  YCM_EXPORT const std::string &Base() const;
+  YCM_EXPORT const std::string &FoldedCase() const;
+  YCM_EXPORT const std::string &SwappedCase() const;
 
   inline bool IsBase() const {
     return is_base_;
@@ -72,6 +66,29 @@ public:
     return is_uppercase_;
   }
 
+  // The character's normal, base and folded case IDs, plus whether it is
+  // uppercase, in a single word:
+  //   bits  0-20: normal
+  //   bits 21-41: base
+  //   bits 42-62: folded case
+  //   bit     63: uppercase
+  // so that several characters can be compared at once. Once there are too
+  // many distinct strings for their IDs to fit, new characters can't be packed
+  // and get NOT_PACKED instead.
+  static constexpr uint64_t NOT_PACKED = ~uint64_t{ 0 };
+  static constexpr int PACKED_ID_BITS = 21;
+  static constexpr uint64_t PACKED_ID_MASK =
+    ( uint64_t{ 1 } << PACKED_ID_BITS ) - 1;
+  static constexpr uint64_t PACKED_NORMAL = PACKED_ID_MASK;
+  static constexpr uint64_t PACKED_BASE = PACKED_ID_MASK << PACKED_ID_BITS;
+  static constexpr uint64_t PACKED_FOLDED_CASE =
+    PACKED_ID_MASK << ( 2 * PACKED_ID_BITS );
+  static constexpr uint64_t PACKED_UPPERCASE = uint64_t{ 1 } << 63;
+
+  inline uint64_t Packed() const {
+    return packed_;
+  }
+
   inline bool operator== ( const Character &other ) const {
     return normal_ == other.normal_;
   }
@@ -97,14 +114,16 @@ public:
   }
 
 private:
-  std::string normal_;
-  std::string base_;
-  std::string folded_case_;
-  std::string swapped_case_;
+  // IDs of the interned strings
+  uint32_t normal_;
+  uint32_t base_;
+  uint32_t folded_case_;
+  uint32_t swapped_case_;
   bool is_base_;
   bool is_letter_;
   bool is_punctuation_;
   bool is_uppercase_;
+  uint64_t packed_;
 };
 
 
@@ -18,60 +18,199 @@
 #include "CodePoint.h"
 #include "Repository.h"
 
-#include <algorithm>
 #include <array>
-#include <cstring>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
 
 namespace YouCompleteMe {
 
 namespace {
 
-int GetCodePointLength( uint8_t leading_byte ) {
+// Code points are looked up by their scalar value in two stages: the block of
+// BLOCK_SIZE code points it's in, then its entry in that block, which is its
+// index in the Unicode table plus one, or 0 if it isn't in the table. Blocks
+// without any code point in the table all share the first block.
+constexpr char32_t MAX_CODE_POINT = 0x10FFFF;
+constexpr size_t BLOCK_BITS = 6;
+constexpr size_t BLOCK_SIZE = size_t{ 1 } << BLOCK_BITS;
+constexpr size_t NUM_BLOCKS = ( MAX_CODE_POINT + 1 ) / BLOCK_SIZE;
+
+struct CodePointIndex {
+  std::array< uint16_t, NUM_BLOCKS > block_of{};
+  std::vector< std::array< uint32_t, BLOCK_SIZE > > blocks{ 1 };
+};
+
+
+// The length of a code point from the 5 high bits of its leading byte, or 0
+// if they can't start one.
+constexpr std::array< uint8_t, 32 > CODE_POINT_LENGTHS = {
   // 0xxxxxxx
-  if ( ( leading_byte & 0x80 ) == 0x00 ) {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  // 10xxxxxx
+  0, 0, 0, 0, 0, 0, 0, 0,
+  // 110xxxxx
+  2, 2, 2, 2,
+  // 1110xxxx
+  3, 3,
+  // 11110xxx
+  4,
+  // 11111xxx
+  0
+};
+
+// The smallest code point each length can encode; anything less is overlong.
+constexpr std::array< char32_t, 5 > MIN_CODE_POINTS = {
+  0, 0, 0x80, 0x800, 0x10000 };
+
+
+// Decodes the code point text starts with and returns its length in bytes.
+// The text must be well-formed UTF-8 (see table 3-7 in
+// https://www.unicode.org/versions/Unicode13.0.0/ch03.pdf#G7404): overlong
+// encodings, surrogates, and code points above U+10FFFF are errors.
+size_t DecodeCodePoint( std::string_view text, char32_t &code_point ) {
+  auto leading_byte = static_cast< uint8_t >( text[ 0 ] );
+  if ( leading_byte < 0x80 ) {
+    code_point = leading_byte;
     return 1;
   }
-  // 110xxxxx
-  if ( ( leading_byte & 0xe0 ) == 0xc0 ) {
-    return 2;
+
+  size_t length = CODE_POINT_LENGTHS[ leading_byte >> 3 ];
+  if ( length == 0 ) {
+    throw UnicodeDecodeError( "Invalid leading byte in code point." );
   }
-  // 1110xxxx
-  if ( ( leading_byte & 0xf0 ) == 0xe0 ) {
-    return 3;
+  if ( text.size() < length ) {
+    throw UnicodeDecodeError( "Invalid code point length." );
   }
-  // 11110xxx
-  if ( ( leading_byte & 0xf8 ) == 0xf0 ) {
-    return 4;
+
+  // Continuation bytes all start with bits '10'; any other bits are collected
+  // and checked once.
+  char32_t value = leading_byte & ( 0x7F >> length );
+  uint8_t invalid_bits = 0;
+  for ( size_t i = 1; i < length; ++i ) {
+    auto byte = static_cast< uint8_t >( text[ i ] );
+    invalid_bits |= ( byte & 0xC0 ) ^ 0x80;
+    value = ( value << 6 ) | ( byte & 0x3F );
+  }
+  if ( invalid_bits ) {
+    throw UnicodeDecodeError( "Invalid continuation byte in code point." );
+  }
+  if ( value < MIN_CODE_POINTS[ length ] ||
+       value > MAX_CODE_POINT ||
+       ( value >= 0xD800 && value <= 0xDFFF ) ) {
+    throw UnicodeDecodeError( "Invalid code point." );
   }
-  throw UnicodeDecodeError( "Invalid leading byte in code point." );
+
+  code_point = value;
+  return length;
 }
 
 
-RawCodePoint FindCodePoint( std::string_view text ) {
+const auto &UnicodeTable() {
 #include "UnicodeTable.inc"
 
-  // Do a binary search on the array of code points to find the raw code point
-  // corresponding to the text. If no code point is found, return the default
-  // raw code point for that text.
-  const auto& original = code_points.original;
-
-  auto it = std::lower_bound( original.begin(), original.end(), text );
-  if ( it != original.end() && text == *it ) {
-    auto index = static_cast< size_t >( std::distance( original.begin(), it ) );
-    return { *it,
-             code_points.normal[ index ],
-             code_points.folded_case[ index ],
-             code_points.swapped_case[ index ],
-             code_points.is_letter[ index ],
-             code_points.is_punctuation[ index ],
-             code_points.is_uppercase[ index ],
-             code_points.break_property[ index ],
-             code_points.combining_class[ index ] };
+  return code_points;
+}
+
+
+CodePointIndex BuildCodePointIndex() {
+  const auto &original = UnicodeTable().original;
+
+  CodePointIndex index;
+  for ( size_t i = 0; i < original.size(); ++i ) {
+    char32_t code_point;
+    DecodeCodePoint( original[ i ], code_point );
+    auto &block = index.block_of[ code_point >> BLOCK_BITS ];
+    if ( block == 0 ) {
+      block = static_cast< uint16_t >( index.blocks.size() );
+      index.blocks.emplace_back();
+    }
+    index.blocks[ block ][ code_point & ( BLOCK_SIZE - 1 ) ] =
+      static_cast< uint32_t >( i + 1 );
+  }
+  return index;
+}
+
+
+RawCodePoint FindCodePoint( std::string_view text ) {
+  static const CodePointIndex index = BuildCodePointIndex();
+
+  // Look up the raw code point corresponding to the text. If no code point is
+  // found, return the default raw code point for that text.
+  char32_t code_point;
+  if ( text.empty() || DecodeCodePoint( text, code_point ) != text.size() ) {
+    return { text, text, text, text, false, false, false, 0, 0 };
   }
 
-  return { text, text, text, text, false, false, false, 0, 0 };
+  uint32_t entry = index.blocks[ index.block_of[ code_point >> BLOCK_BITS ] ]
+                               [ code_point & ( BLOCK_SIZE - 1 ) ];
+  if ( entry == 0 ) {
+    return { text, text, text, text, false, false, false, 0, 0 };
+  }
+
+  const auto &code_points = UnicodeTable();
+  size_t i = entry - 1;
+  return { code_points.original[ i ],
+           code_points.normal[ i ],
+           code_points.folded_case[ i ],
+           code_points.swapped_case[ i ],
+           code_points.is_letter[ i ],
+           code_points.is_punctuation[ i ],
+           code_points.is_uppercase[ i ],
+           code_points.break_property[ i ],
+           code_points.combining_class[ i ] };
 }
 
+
+// The repository's code point for each scalar value, in blocks like the
+// Unicode table's index, so that each is only looked up by its text once. The
+// code points are acquired so that they outlive any trimming of the
+// repository.
+class CodePointCache {
+public:
+  CodePointCache() = default;
+  CodePointCache( const CodePointCache& ) = delete;
+  CodePointCache& operator=( const CodePointCache& ) = delete;
+
+  ~CodePointCache() {
+    for ( auto &block : blocks_ ) {
+      delete block.load( std::memory_order_relaxed );
+    }
+  }
+
+  const CodePoint *Get( std::string_view text, char32_t code_point ) {
+    auto &entry = GetBlock( code_point >> BLOCK_BITS )
+                    [ code_point & ( BLOCK_SIZE - 1 ) ];
+    const CodePoint *cached = entry.load( std::memory_order_acquire );
+    if ( !cached ) {
+      // Threads racing to look it up get the same code point.
+      cached = Repository< CodePoint >::Instance().AcquireElements(
+        std::vector< std::string_view >{ text } ).front();
+      entry.store( cached, std::memory_order_release );
+    }
+    return cached;
+  }
+
+private:
+  using Block = std::array< std::atomic< const CodePoint* >, BLOCK_SIZE >;
+
+  Block &GetBlock( size_t index ) {
+    Block *block = blocks_[ index ].load( std::memory_order_acquire );
+    if ( !block ) {
+      auto new_block = std::make_unique< Block >();
+      if ( blocks_[ index ].compare_exchange_strong(
+             block, new_block.get(), std::memory_order_acq_rel ) ) {
+        block = new_block.release();
+      }
+    }
+    return *block;
+  }
+
+  std::array< std::atomic< Block* >, NUM_BLOCKS > blocks_{};
+};
+
 } // unnamed namespace
 
 CodePoint::CodePoint( std::string_view code_point )
@@ -93,19 +232,29 @@ CodePoint::CodePoint( RawCodePoint&& code_point )
 
 
 CodePointSequence BreakIntoCodePoints( std::string_view text ) {
-  // NOTE: for efficiency, we don't check if the number of continuation bytes
-  // and the bytes themselves are valid (they must start with bits '10').
-  std::vector< std::string > code_points;
-  for ( auto iter = text.begin(); iter != text.end(); ) {
-    int length = GetCodePointLength( static_cast< uint8_t >( *iter ) );
-    if ( text.end() - iter < length ) {
-      throw UnicodeDecodeError( "Invalid code point length." );
-    }
-    code_points.emplace_back( iter, iter + length );
-    iter += length;
+  static CodePointCache cache;
+
+  CodePointSequence code_points;
+  while ( !text.empty() ) {
+    char32_t code_point;
+    size_t length = DecodeCodePoint( text, code_point );
+    code_points.push_back( cache.Get( text.substr( 0, length ), code_point ) );
+    text.remove_prefix( length );
   }
+  return code_points;
+}
 
-  return Repository< CodePoint >::Instance().GetElements( std::move( code_points ) );
+
+bool IsValidUtf8( std::string_view text ) {
+  try {
+    while ( !text.empty() ) {
+      char32_t code_point;
+      text.remove_prefix( DecodeCodePoint( text, code_point ) );
+    }
+    return true;
+  } catch ( const UnicodeDecodeError& ) {
+    return false;
+  }
 }
 
 
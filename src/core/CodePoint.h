@@ -22,6 +22,10 @@
 #include <string>
 #include <vector>
 
+#ifdef YCM_ABSEIL_SUPPORTED
+#include <absl/container/inlined_vector.h>
+#endif
+
 namespace YouCompleteMe {
 
 // See
@@ -140,13 +144,24 @@ private:
 };
 
 
+// Most words have few code points, so they are kept inline.
+#ifdef YCM_ABSEIL_SUPPORTED
+using CodePointSequence = absl::InlinedVector< const CodePoint *, 32 >;
+#else
 using CodePointSequence = std::vector< const CodePoint * >;
+#endif
 
 
-// Split a UTF-8 encoded string into UTF-8 code points.
+// Split a UTF-8 encoded string into UTF-8 code points. They are decoded
+// straight from the text, and each is looked up by its scalar value, so nothing
+// is allocated unless the text has more code points than fit inline.
 YCM_EXPORT CodePointSequence BreakIntoCodePoints( std::string_view text );
 
 
+// Whether the text is well-formed UTF-8, i.e. BreakIntoCodePoints won't throw.
+YCM_EXPORT bool IsValidUtf8( std::string_view text );
+
+
 // Thrown when an error occurs while decoding a UTF-8 string.
 struct YCM_EXPORT UnicodeDecodeError : std::runtime_error {
   using std::runtime_error::runtime_error;
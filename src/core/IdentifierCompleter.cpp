@@ -61,6 +61,28 @@ void IdentifierCompleter::ClearForFileAndAddIdentifiersToDatabase(
 }
 
 
+void IdentifierCompleter::ClearForFileAndAddIdentifiersToDatabase(
+  const std::vector< std::string_view >& new_candidates,
+  std::string filetype,
+  std::string filepath ) {
+  identifier_database_.RecreateIdentifiers( new_candidates,
+                                            std::move( filetype ),
+                                            std::move( filepath ) );
+}
+
+
+void IdentifierCompleter::UpdateIdentifiersInDatabase(
+  const std::vector< std::string_view >& added_candidates,
+  const std::vector< std::string >& removed_candidates,
+  std::string filetype,
+  std::string filepath ) {
+  identifier_database_.UpdateIdentifiers( added_candidates,
+                                          removed_candidates,
+                                          std::move( filetype ),
+                                          std::move( filepath ) );
+}
+
+
 void IdentifierCompleter::AddIdentifiersToDatabaseFromTagFiles(
   std::vector< std::string >& absolute_paths_to_tag_files ) {
   for( auto&& path : absolute_paths_to_tag_files ) {
@@ -70,6 +92,20 @@ void IdentifierCompleter::AddIdentifiersToDatabaseFromTagFiles(
 }
 
 
+void IdentifierCompleter::AddIdentifiersToDatabaseFromTagFiles(
+  FiletypeIdentifierMap&& filetype_identifier_map ) {
+  identifier_database_.RecreateIdentifiers(
+    std::move( filetype_identifier_map ) );
+}
+
+
+void IdentifierCompleter::SetParallelFor( ParallelFor parallel_for,
+                                          size_t num_threads ) {
+  identifier_database_.SetParallelFor( std::move( parallel_for ),
+                                       num_threads );
+}
+
+
 std::vector< std::string > IdentifierCompleter::CandidatesForQuery(
   std::string_view query,
   const size_t max_candidates ) const {
@@ -21,6 +21,7 @@
 #include "IdentifierDatabase.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 
@@ -55,9 +56,33 @@ public:
     std::string filetype,
     std::string filepath );
 
+  // Same as above, for views into a buffer (e.g. the file contents), which
+  // avoids copying identifiers that are already known.
+  void ClearForFileAndAddIdentifiersToDatabase(
+    const std::vector< std::string_view >& new_candidates,
+    std::string filetype,
+    std::string filepath );
+
+  // Adds and removes identifiers for the file, leaving the rest as they are.
+  void UpdateIdentifiersInDatabase(
+    const std::vector< std::string_view >& added_candidates,
+    const std::vector< std::string >& removed_candidates,
+    std::string filetype,
+    std::string filepath );
+
   YCM_EXPORT void AddIdentifiersToDatabaseFromTagFiles(
     std::vector< std::string >& absolute_paths_to_tag_files );
 
+  // Same as above, for tags which have already been extracted from the files
+  // (e.g. in parallel, with ExtractIdentifiersFromTagLines).
+  YCM_EXPORT void AddIdentifiersToDatabaseFromTagFiles(
+    FiletypeIdentifierMap&& filetype_identifier_map );
+
+  // Lets queries over many identifiers be split between threads. See
+  // IdentifierDatabase::SetParallelFor.
+  YCM_EXPORT void SetParallelFor( ParallelFor parallel_for,
+                                  size_t num_threads );
+
   // Only provided for tests!
   YCM_EXPORT std::vector< std::string > CandidatesForQuery(
     std::string_view query,
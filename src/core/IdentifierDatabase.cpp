@@ -19,6 +19,7 @@
 
 #include "Candidate.h"
 #include "IdentifierUtils.h"
+#include "QueryMatcher.h"
 #include "Repository.h"
 #include "Result.h"
 #include "Utils.h"
@@ -39,24 +40,96 @@ template< typename T >
 using Hash = std::hash< T >;
 } // namespace YouCompleteMe
 #endif
+#include <algorithm>
+#include <array>
+#include <iterator>
 #include <memory>
 
 namespace YouCompleteMe {
 
 namespace {
-struct CandidateHasher {
-  size_t operator() ( const Candidate* c ) const noexcept {
-    static Hash< std::string > h;
-    return h(c->Text());
-  }
-};
-struct CandidateCompareEq {
-  bool operator() ( const Candidate* a, const Candidate* b ) const noexcept {
-    return a->Text() == b->Text();
-  }
-};
-} // namespace
 
+// A query is split between threads only if each of them gets at least this
+// many candidates; below that, starting them costs more than it saves.
+constexpr size_t MIN_CANDIDATES_PER_TASK = 16384;
+
+// Each thread gets a few parts of the index, so that one which happens to get
+// a part with many matches doesn't hold up the others.
+constexpr size_t TASKS_PER_THREAD = 4;
+
+// Calls f( position, candidate, match ) for each candidate which the query
+// matches, of those that for_each_possible_match( g ) calls g( position,
+// candidate ) for. They are matched in batches of QueryMatcher::BATCH_SIZE.
+template< typename ForEachPossibleMatch, typename F >
+void MatchCandidates( ForEachPossibleMatch&& for_each_possible_match,
+                      const QueryMatcher &matcher,
+                      F&& f ) {
+  std::array< const Candidate*, QueryMatcher::BATCH_SIZE > batch;
+  std::array< uint32_t, QueryMatcher::BATCH_SIZE > positions;
+  std::array< CandidateMatch, QueryMatcher::BATCH_SIZE > matches;
+  size_t batch_size = 0;
+  auto match_batch = [ & ]() {
+    matcher.Match( { batch.data(), batch_size }, matches.data() );
+    for ( size_t i = 0; i < batch_size; ++i ) {
+      if ( matches[ i ].is_subsequence ) {
+        f( positions[ i ], batch[ i ], matches[ i ] );
+      }
+    }
+    batch_size = 0;
+  };
+
+  for_each_possible_match(
+    [ & ]( uint32_t position, const Candidate* candidate ) {
+      positions[ batch_size ] = position;
+      batch[ batch_size++ ] = candidate;
+      if ( batch_size == batch.size() ) {
+        match_batch();
+      }
+    } );
+  match_batch();
+}
+
+
+// Returns the max_results best results (or all of them, if it's 0) of the
+// candidates which for_each_possible_match goes through (see MatchCandidates),
+// best first, and appends the positions of all of the matches to
+// matched_positions. A result's word boundary matches are only worked out if
+// it could make it in.
+template< typename ForEachPossibleMatch >
+std::vector< Result > BestResults(
+  ForEachPossibleMatch&& for_each_possible_match,
+  const QueryMatcher &matcher,
+  const Word &query,
+  size_t max_results,
+  std::vector< uint32_t > &matched_positions ) {
+  TopResults< Result > results( max_results );
+  MatchCandidates( for_each_possible_match,
+                   matcher,
+                   [ & ]( uint32_t position,
+                          const Candidate* candidate,
+                          const CandidateMatch &match ) {
+                     matched_positions.push_back( position );
+                     Result result = Result::UpperBound(
+                       candidate,
+                       &query,
+                       match.char_match_index_sum,
+                       match.query_is_candidate_prefix );
+                     if ( results.CouldKeep( result ) ) {
+                       result.ComputeWordBoundaryMatches();
+                       results.Add( result );
+                     }
+                   } );
+  return results.Take();
+}
+
+
+bool StartsWith( const CharacterSequence &characters,
+                 const CharacterSequence &prefix ) {
+  return prefix.size() <= characters.size() &&
+         std::equal( prefix.begin(), prefix.end(), characters.begin() );
+}
+
+} // unnamed namespace
 
 
 IdentifierDatabase::IdentifierDatabase()
@@ -64,6 +137,18 @@ IdentifierDatabase::IdentifierDatabase()
 }
 
 
+IdentifierDatabase::~IdentifierDatabase() {
+  for ( const auto& [ _, filetype_candidates ] : filetype_candidate_map_ ) {
+    for ( const auto& [ _, candidates ] : filetype_candidates.files ) {
+      candidate_repository_.ReleaseElements( candidates );
+    }
+    for ( const auto& [ _, candidates ] : filetype_candidates.tag_files ) {
+      candidate_repository_.ReleaseElements( candidates );
+    }
+  }
+}
+
+
 void IdentifierDatabase::RecreateIdentifiers(
   FiletypeIdentifierMap&& filetype_identifier_map ) {
   // std::lock_guard locker( filetype_candidate_map_mutex_ );
@@ -72,7 +157,8 @@ void IdentifierDatabase::RecreateIdentifiers(
     for ( auto&& [ filepath, identifiers ] : paths_to_candidates ) {
       RecreateIdentifiersNoLock( std::move( identifiers ),
                                  std::string( filetype ),
-                                 std::string( filepath ) );
+                                 std::string( filepath ),
+                                 &FiletypeCandidates::tag_files );
     }
   }
 }
@@ -83,18 +169,20 @@ void IdentifierDatabase::AddSingleIdentifier(
   std::string&& filetype,
   std::string&& filepath ) {
   // std::lock_guard locker( filetype_candidate_map_mutex_ );
-  std::vector< std::string > candidate_vector( 1 );
-  auto candidate_pointer = candidate_repository_.GetElements(
-         { new_candidate } )[ 0 ];
-  auto& current_identifier_set = GetCandidateSet( std::move( filetype ),
-                                                  std::move( filepath ) );
-  auto it = std::find_if( current_identifier_set.begin(),
-                          current_identifier_set.end(),
-                          [ candidate_pointer ]( const Candidate& c ) {
-                                return c.Text() == candidate_pointer->Text();
-                          } );
+  auto candidate_pointers = candidate_repository_.AcquireElements(
+         std::vector< std::string_view >{ new_candidate } );
+  auto candidate_pointer = candidate_pointers[ 0 ];
+  auto& filetype_candidates = GetFiletypeCandidates( std::move( filetype ) );
+  auto& current_identifier_set =
+    filetype_candidates.files[ std::move( filepath ) ];
+  auto it = std::find( current_identifier_set.begin(),
+                       current_identifier_set.end(),
+                       candidate_pointer );
   if ( it == current_identifier_set.end() ) {
-    current_identifier_set.push_back( candidate_pointer->clone() );
+    current_identifier_set.push_back( candidate_pointer );
+    filetype_candidates.index.Add( candidate_pointers );
+  } else {
+    candidate_repository_.ReleaseElements( candidate_pointers );
   }
 }
 
@@ -106,7 +194,95 @@ void IdentifierDatabase::RecreateIdentifiers(
   // std::lock_guard locker( filetype_candidate_map_mutex_ );
   RecreateIdentifiersNoLock( std::move( new_candidates ),
                              std::move( filetype ),
-                             std::move( filepath ) );
+                             std::move( filepath ),
+                             &FiletypeCandidates::files );
+}
+
+
+void IdentifierDatabase::RecreateIdentifiers(
+  const std::vector< std::string_view >& new_candidates,
+  std::string&& filetype,
+  std::string&& filepath ) {
+  // std::lock_guard locker( filetype_candidate_map_mutex_ );
+  RecreateIdentifiersNoLock( new_candidates,
+                             std::move( filetype ),
+                             std::move( filepath ),
+                             &FiletypeCandidates::files );
+}
+
+
+void IdentifierDatabase::UpdateIdentifiers(
+  const std::vector< std::string_view >& added_candidates,
+  const std::vector< std::string >& removed_candidates,
+  std::string&& filetype,
+  std::string&& filepath ) {
+  // std::lock_guard locker( filetype_candidate_map_mutex_ );
+  auto& filetype_candidates = GetFiletypeCandidates( std::move( filetype ) );
+  auto& current_identifier_set =
+    filetype_candidates.files[ std::move( filepath ) ];
+
+  if ( !removed_candidates.empty() ) {
+    // Removed identifiers are matched by their candidates rather than their
+    // text, as the repository turns some of them (e.g. very long ones) into
+    // the same candidate.
+    std::vector< std::string_view > removed_texts( removed_candidates.begin(),
+                                                   removed_candidates.end() );
+    auto removed_pointers = candidate_repository_.GetElements( removed_texts );
+    HashSet< const Candidate*,
+             Hash< const Candidate* >,
+             std::equal_to<> > removed( removed_pointers.begin(),
+                                        removed_pointers.end() );
+    auto released = std::partition( current_identifier_set.begin(),
+                                     current_identifier_set.end(),
+                                     [ &removed ]( const Candidate* candidate ) {
+                                       return !removed.contains( candidate );
+                                     } );
+    Repository< Candidate >::Sequence released_candidates(
+      released, current_identifier_set.end() );
+    filetype_candidates.index.Remove( released_candidates );
+    candidate_repository_.ReleaseElements( released_candidates );
+    current_identifier_set.erase( released, current_identifier_set.end() );
+  }
+
+  auto candidate_pointers = candidate_repository_.AcquireElements(
+                  added_candidates );
+  filetype_candidates.index.Add( candidate_pointers );
+  current_identifier_set.insert( current_identifier_set.end(),
+                                 candidate_pointers.begin(),
+                                 candidate_pointers.end() );
+}
+
+
+template< typename BestResultsOfTask >
+std::vector< Result > IdentifierDatabase::ResultsInParallel(
+  size_t num_tasks,
+  size_t max_results,
+  BestResultsOfTask&& best_results ) const {
+  std::vector< std::vector< Result > > task_results( num_tasks );
+
+  parallel_for_( num_tasks, [ & ]( size_t task ) {
+    task_results[ task ] = best_results( task );
+  } );
+
+  // The tasks' results are merged in pairs, in log2( num_tasks ) rounds.
+  for ( size_t width = 1; width < num_tasks; width *= 2 ) {
+    for ( size_t task = 0; task + width < num_tasks; task += 2 * width ) {
+      std::vector< Result > &first = task_results[ task ];
+      std::vector< Result > &second = task_results[ task + width ];
+      std::vector< Result > merged;
+      merged.reserve( first.size() + second.size() );
+      std::merge( first.begin(), first.end(),
+                  second.begin(), second.end(),
+                  std::back_inserter( merged ) );
+      if ( max_results > 0 && merged.size() > max_results ) {
+        merged.erase( merged.begin() + static_cast< ptrdiff_t >( max_results ),
+                      merged.end() );
+      }
+      first = std::move( merged );
+      second = {};
+    }
+  }
+  return std::move( task_results[ 0 ] );
 }
 
 
@@ -123,71 +299,120 @@ std::vector< Result > IdentifierDatabase::ResultsForQueryAndType(
       return {};
     }
   }
-  Word query_object( query );
-
-  HashSet< const Candidate *,
-           CandidateHasher,
-           CandidateCompareEq > seen_candidates;
-  seen_candidates.reserve( candidate_repository_.NumStoredElements() );
-  std::vector< Result > results;
+  std::shared_ptr< const Word > query_word = QueryWord( query );
+  const Word &query_object = *query_word;
+  const FiletypeCandidates &filetype_candidates = it->second;
+  const CandidateIndex &index = filetype_candidates.index;
 
+  // The query only needs to look at what the last one matched if it starts
+  // with the last one's characters.
+  std::shared_ptr< const MatchedQuery > last_query;
   {
-    // std::lock_guard locker( filetype_candidate_map_mutex_ );
-    auto& paths_to_candidates = it->second;
-    for ( const auto& [ _, candidates ] : paths_to_candidates ) {
-      for ( const Candidate& candidate : candidates ) {
-        if ( !seen_candidates.insert( &candidate ).second ) {
-          continue;
-        }
-
-        if ( candidate.IsEmpty() ||
-             !candidate.ContainsBytes( query_object ) ) {
-          continue;
-        }
+    std::lock_guard locker( last_query_mutex_ );
+    last_query = filetype_candidates.last_query;
+  }
+  if ( last_query && !StartsWith( query_object.Characters(),
+                                  last_query->characters ) ) {
+    last_query.reset();
+  }
 
-        Result result = candidate.QueryMatchResult( query_object );
+  // The candidates are split between tasks either way: by their positions in
+  // the index, or among the last query's matches.
+  size_t num_candidates = last_query ? last_query->positions.size()
+                                     : index.Size();
+  size_t num_parts = last_query ? last_query->positions.size()
+                                : index.NumPositions();
+  size_t num_tasks = 1;
+  if ( parallel_for_ && num_threads_ > 1 ) {
+    num_tasks = std::clamp< size_t >( num_candidates / MIN_CANDIDATES_PER_TASK,
+                                      1,
+                                      num_threads_ * TASKS_PER_THREAD );
+  }
 
-        if ( result.IsSubsequence() ) {
-          results.push_back( result );
+  QueryMatcher matcher( query_object );
+  std::vector< std::vector< uint32_t > > task_positions( num_tasks );
+  auto best_results = [ & ]( size_t task ) {
+    size_t first = num_parts * task / num_tasks;
+    size_t last = num_parts * ( task + 1 ) / num_tasks;
+    return BestResults(
+      [ & ]( auto&& f ) {
+        if ( last_query ) {
+          index.ForEachPossibleMatch(
+            query_object,
+            std::span( last_query->positions ).subspan( first, last - first ),
+            f );
+        } else {
+          index.ForEachPossibleMatch( query_object, first, last, f );
         }
-      }
-    }
+      },
+      matcher,
+      query_object,
+      max_results,
+      task_positions[ task ] );
+  };
+  std::vector< Result > results = num_tasks > 1
+    ? ResultsInParallel( num_tasks, max_results, best_results )
+    : best_results( 0 );
+
+  // An empty query matches everything, so there is nothing to gain from it.
+  if ( query_object.IsEmpty() ) {
+    return results;
   }
 
-  PartialSort( results, max_results );
+  // The tasks' positions are in order, and so are the tasks.
+  auto matched_query = std::make_shared< MatchedQuery >();
+  matched_query->characters = query_object.Characters();
+  for ( const auto &positions : task_positions ) {
+    matched_query->positions.insert( matched_query->positions.end(),
+                                     positions.begin(),
+                                     positions.end() );
+  }
+  {
+    std::lock_guard locker( last_query_mutex_ );
+    filetype_candidates.last_query = std::move( matched_query );
+  }
   return results;
 }
 
 
+void IdentifierDatabase::SetParallelFor( ParallelFor parallel_for,
+                                         size_t num_threads ) {
+  parallel_for_ = std::move( parallel_for );
+  num_threads_ = std::max< size_t >( num_threads, 1 );
+}
+
+
 // WARNING: You need to hold the filetype_candidate_map_mutex_ before calling
-// this function and while using the returned set.
-std::vector< Candidate > &IdentifierDatabase::GetCandidateSet(
-  std::string&& filetype,
-  std::string&& filepath ) {
-  return filetype_candidate_map_[ std::move( filetype ) ]
-                                [ std::move( filepath ) ];
+// this function and while using the returned candidates.
+IdentifierDatabase::FiletypeCandidates &
+IdentifierDatabase::GetFiletypeCandidates( std::string&& filetype ) {
+  auto &filetype_candidates = filetype_candidate_map_[ std::move( filetype ) ];
+  std::lock_guard locker( last_query_mutex_ );
+  filetype_candidates.last_query.reset();
+  return filetype_candidates;
 }
 
 
 // WARNING: You need to hold the filetype_candidate_map_mutex_ before calling
 // this function and while using the returned set.
+template< typename Identifiers >
 void IdentifierDatabase::RecreateIdentifiersNoLock(
-  std::vector< std::string >&& new_candidates,
+  Identifiers&& new_candidates,
   std::string&& filetype,
-  std::string&& filepath ) {
+  std::string&& filepath,
+  FilepathToCandidates FiletypeCandidates::* files ) {
 
-  auto& current_identifier_set = GetCandidateSet( std::move( filetype ),
-                                                  std::move( filepath ) );
-  auto candidate_pointers = candidate_repository_.GetElements(
-                  std::move( new_candidates ) );
-  current_identifier_set.clear();
-  current_identifier_set.reserve( candidate_pointers.size() );
-  std::transform( candidate_pointers.begin(),
-                  candidate_pointers.end(),
-                  std::back_inserter( current_identifier_set ),
-                  []( const Candidate* candidate_ptr ) {
-                    return candidate_ptr->clone();
-                  } );
+  auto& filetype_candidates = GetFiletypeCandidates( std::move( filetype ) );
+  auto& current_identifier_set =
+    ( filetype_candidates.*files )[ std::move( filepath ) ];
+  auto candidate_pointers = candidate_repository_.AcquireElements(
+                  std::forward< Identifiers >( new_candidates ) );
+  // Add before removing, so that candidates which are in both don't leave the
+  // index (and have to be merged back in).
+  filetype_candidates.index.Add( candidate_pointers );
+  filetype_candidates.index.Remove( current_identifier_set );
+  candidate_repository_.ReleaseElements( current_identifier_set );
+  current_identifier_set = std::move( candidate_pointers );
 }
 
 } // namespace YouCompleteMe
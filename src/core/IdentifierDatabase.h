@@ -31,15 +31,22 @@ template< typename K, typename V >
 using HashMap = std::unordered_map< K, V >;
 } // namespace YouCompleteMe
 #endif
+#include "CandidateIndex.h"
+#include "Character.h"
+
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace YouCompleteMe {
 
 class Candidate;
 class Result;
+class Word;
 template< typename Candidate >
 class Repository;
 
@@ -50,6 +57,12 @@ using FilepathToIdentifiers = HashMap< std::string, std::vector< std::string > >
 // filetype -> (filepath -> identifiers)
 using FiletypeIdentifierMap = HashMap< std::string, FilepathToIdentifiers >;
 
+// Calls task( 0 ), ..., task( num_tasks - 1 ), on whatever threads it likes,
+// and returns once they have all finished.
+using ParallelFor = std::function< void(
+  size_t num_tasks,
+  const std::function< void( size_t task_index ) > &task ) >;
+
 
 // This class stores the database of identifiers the identifier completer has
 // seen. It stores them in a data structure that makes it easy to tell which
@@ -63,6 +76,7 @@ using FiletypeIdentifierMap = HashMap< std::string, FilepathToIdentifiers >;
 class IdentifierDatabase {
 public:
   YCM_EXPORT IdentifierDatabase();
+  YCM_EXPORT ~IdentifierDatabase();
   IdentifierDatabase( const IdentifierDatabase& ) = delete;
   IdentifierDatabase& operator=( const IdentifierDatabase& ) = delete;
 
@@ -71,6 +85,8 @@ public:
     std::string&& filetype,
     std::string&& filepath );
 
+  // Replaces the identifiers which tag files give for each file. They are
+  // kept apart from the file's own identifiers, so neither replaces the other.
   void RecreateIdentifiers( FiletypeIdentifierMap&& filetype_identifier_map );
 
   void RecreateIdentifiers(
@@ -78,6 +94,20 @@ public:
     std::string&& filetype,
     std::string&& filepath );
 
+  // The views only need to be valid for the duration of the call.
+  void RecreateIdentifiers(
+    const std::vector< std::string_view >& new_candidates,
+    std::string&& filetype,
+    std::string&& filepath );
+
+  // Applies a change in the set of identifiers in the file, as opposed to
+  // replacing them all.
+  void UpdateIdentifiers(
+    const std::vector< std::string_view >& added_candidates,
+    const std::vector< std::string >& removed_candidates,
+    std::string&& filetype,
+    std::string&& filepath );
+
   void ClearCandidatesStoredForFile( std::string&& filetype,
                                      std::string&& filepath );
 
@@ -86,27 +116,66 @@ public:
     const std::string &filetype,
     const size_t max_results ) const;
 
-private:
-  std::vector< Candidate > &GetCandidateSet(
-    std::string&& filetype,
-    std::string&& filepath );
+  // Lets queries over many candidates be split between up to num_threads
+  // threads, with parallel_for. Without it, queries run on the calling thread.
+  void SetParallelFor( ParallelFor parallel_for, size_t num_threads );
 
+private:
+  // filepath -> ( candidate ), which are acquired from the repository
+  using FilepathToCandidates =
+    HashMap< std::string, std::vector< const Candidate* > >;
+
+  // The characters of a query, and the positions in the index of all of the
+  // candidates it matched. A query which starts with the same characters can
+  // only match some of those candidates, so as the user types, each query only
+  // has to look at what the last one matched.
+  struct MatchedQuery {
+    CharacterSequence characters;
+    std::vector< uint32_t > positions;
+  };
+
+  struct FiletypeCandidates {
+    FilepathToCandidates files;
+    // The identifiers which tag files give for each file
+    FilepathToCandidates tag_files;
+    // The candidates of all of the files, once each
+    CandidateIndex index;
+    // The last query, until the candidates change. Guarded by
+    // last_query_mutex_.
+    mutable std::shared_ptr< const MatchedQuery > last_query;
+  };
+
+  // Clears the filetype's last query, since the caller may change its
+  // candidates.
+  FiletypeCandidates &GetFiletypeCandidates( std::string&& filetype );
+
+  // Splits a query into num_tasks tasks, where best_results( task ) finds the
+  // best max_results results (or all of them, if it's 0) of the task's part of
+  // the candidates, and merges them.
+  template< typename BestResultsOfTask >
+  std::vector< Result > ResultsInParallel(
+    size_t num_tasks,
+    size_t max_results,
+    BestResultsOfTask&& best_results ) const;
+
+  template< typename Identifiers >
   void RecreateIdentifiersNoLock(
-    std::vector< std::string >&& new_candidates,
+    Identifiers&& new_candidates,
     std::string&& filetype,
-    std::string&& filepath );
-
+    std::string&& filepath,
+    FilepathToCandidates FiletypeCandidates::* files );
 
-  // filepath -> ( candidate )
-  using FilepathToCandidates = HashMap< std::string, std::vector< Candidate > >;
 
-  // filetype -> ( filepath -> ( candidate ) )
-  using FiletypeCandidateMap = HashMap< std::string, FilepathToCandidates >;
+  // filetype -> ( filepath -> ( candidate ), and their index )
+  using FiletypeCandidateMap = HashMap< std::string, FiletypeCandidates >;
 
 
   Repository< Candidate > &candidate_repository_;
 
   FiletypeCandidateMap filetype_candidate_map_;
+  ParallelFor parallel_for_;
+  size_t num_threads_ = 1;
+  mutable std::mutex last_query_mutex_;
   // mutable std::shared_mutex filetype_candidate_map_mutex_;
 };
 
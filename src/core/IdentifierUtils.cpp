@@ -16,6 +16,7 @@
 // along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "IdentifierUtils.h"
+#include "CodePoint.h"
 #include "Utils.h"
 
 #include <array>
@@ -56,7 +57,6 @@ constexpr std::array LANG_TO_FILETYPE = {
 // TL;DR: The only supported format is the one Exuberant Ctags emits.
 FiletypeIdentifierMap ExtractIdentifiersFromTagsFile(
   const fs::path &path_to_tag_file ) {
-  FiletypeIdentifierMap filetype_identifier_map;
   const auto lines = [ &path_to_tag_file ]{
     try {
       return ReadUtf8File( path_to_tag_file );
@@ -65,7 +65,24 @@ FiletypeIdentifierMap ExtractIdentifiersFromTagsFile(
     }
   }();
 
-  for ( auto&& line : lines ) {
+  return ExtractIdentifiersFromTagLines( lines.cbegin(),
+                                         lines.cend(),
+                                         path_to_tag_file );
+}
+
+
+FiletypeIdentifierMap ExtractIdentifiersFromTagLines(
+  std::vector< std::string >::const_iterator first,
+  std::vector< std::string >::const_iterator last,
+  const fs::path &path_to_tag_file ) {
+  FiletypeIdentifierMap filetype_identifier_map;
+
+  // Resolving a path hits the filesystem, and there are usually far fewer
+  // files than tags.
+  HashMap< std::string, std::string > canonical_paths;
+
+  for ( ; first != last; ++first ) {
+    const auto& line = *first;
     // Identifier name is from the start of the line to the first \t.
     const auto id_end = std::find( line.cbegin(), line.cend(), '\t' );
     if ( id_end == line.cend() ) {
@@ -97,14 +114,22 @@ FiletypeIdentifierMap ExtractIdentifiersFromTagsFile(
       return end;
     }();
     std::string_view identifier( line.data(), id_end - line.cbegin() );
-    fs::path path( path_begin, path_end );
-    path = fs::weakly_canonical( path_to_tag_file.parent_path() / path );
+    // Like the buffer lexer, skip what isn't UTF-8 rather than failing the
+    // whole file over it.
+    if ( !IsValidUtf8( identifier ) ) {
+      continue;
+    }
+    auto& path = canonical_paths[ std::string( path_begin, path_end ) ];
+    if ( path.empty() ) {
+      path = fs::weakly_canonical(
+        path_to_tag_file.parent_path() / fs::path( path_begin, path_end ) )
+        .string();
+    }
     std::string_view language( &*lang_begin, lang_end - lang_begin );
     std::string filetype( FindWithDefault( LANG_TO_FILETYPE,
                                            language,
                                            Lowercase( language ) ) );
-    filetype_identifier_map[ std::move( filetype ) ]
-                           [ std::move( path ).string() ]
+    filetype_identifier_map[ std::move( filetype ) ][ path ]
       .emplace_back( identifier );
   }
   return filetype_identifier_map;
@@ -21,12 +21,21 @@
 #include "IdentifierDatabase.h"
 
 #include <filesystem>
+#include <string>
+#include <vector>
 
 namespace YouCompleteMe {
 
 YCM_EXPORT FiletypeIdentifierMap ExtractIdentifiersFromTagsFile(
   const std::filesystem::path &path_to_tag_file );
 
+// Same as above, for the lines [ first, last ) of a tag file which has already
+// been read. This allows a large tag file to be split between threads.
+YCM_EXPORT FiletypeIdentifierMap ExtractIdentifiersFromTagLines(
+  std::vector< std::string >::const_iterator first,
+  std::vector< std::string >::const_iterator last,
+  const std::filesystem::path &path_to_tag_file );
+
 } // namespace YouCompleteMe
 
 #endif /* end of include guard: IDENTIFIERUTILS_CPP_WFFUZNET */
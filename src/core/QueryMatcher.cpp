@@ -0,0 +1,297 @@
+// Copyright (C) 2021 ycmd contributors
+//
+// This file is part of ycmd.
+//
+// ycmd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ycmd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "QueryMatcher.h"
+
+#include "Candidate.h"
+#include "Result.h"
+
+#include <algorithm>
+#include <array>
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#include <immintrin.h>
+#define YCM_QUERY_MATCHER_X86 1
+#endif
+
+namespace YouCompleteMe {
+
+namespace {
+
+// Has bits outside of the masks it's compared under, so never equals a masked
+// character.
+constexpr uint64_t NO_MATCH = 1;
+
+using MatchFunction = void (*)( const QueryMatcher::PackedQuery &query,
+                                const Candidate* const* candidates,
+                                size_t num_candidates,
+                                CandidateMatch* matches );
+
+
+CandidateMatch MatchScalar( const QueryMatcher::PackedQuery &query,
+                            const std::vector< uint64_t > &characters ) {
+  size_t query_length = query.normal.size();
+  if ( characters.size() < query_length ) {
+    return {};
+  }
+
+  size_t query_index = 0;
+  uint32_t index_sum = 0;
+  for ( size_t index = 0; index < characters.size(); ++index ) {
+    uint64_t character = characters[ index ];
+    if ( ( character & Character::PACKED_NORMAL ) ==
+           query.normal[ query_index ] ||
+         ( character & Character::PACKED_FOLDED_CASE ) ==
+           query.folded_case[ query_index ] ||
+         ( character & query.base_mask[ query_index ] ) ==
+           query.base[ query_index ] ) {
+      index_sum += static_cast< uint32_t >( index );
+      if ( ++query_index == query_length ) {
+        return { true, index + 1 == query_index, index_sum };
+      }
+    }
+  }
+  return {};
+}
+
+
+void MatchBatchScalar( const QueryMatcher::PackedQuery &query,
+                       const Candidate* const* candidates,
+                       size_t num_candidates,
+                       CandidateMatch* matches ) {
+  for ( size_t i = 0; i < num_candidates; ++i ) {
+    matches[ i ] = MatchScalar( query, candidates[ i ]->PackedCharacters() );
+  }
+}
+
+#ifdef YCM_QUERY_MATCHER_X86
+
+// One lane per candidate. Each step compares every lane's next character with
+// the query character that lane is waiting for, both gathered, until all of
+// the lanes have matched the whole query or run out of characters.
+__attribute__(( target( "avx2" ) ))
+void MatchFourAvx2( const QueryMatcher::PackedQuery &query,
+                    const Candidate* const* candidates,
+                    size_t num_candidates,
+                    CandidateMatch* matches ) {
+  auto query_length = static_cast< int64_t >( query.normal.size() );
+
+  // Characters are gathered by their address, relative to the first lane's.
+  alignas( 32 ) std::array< int64_t, 4 > offsets{};
+  alignas( 32 ) std::array< int64_t, 4 > lengths{};
+  const auto *origin = reinterpret_cast< const long long* >(
+    candidates[ 0 ]->PackedCharacters().data() );
+  for ( size_t i = 0; i < num_candidates; ++i ) {
+    const auto &characters = candidates[ i ]->PackedCharacters();
+    offsets[ i ] = reinterpret_cast< const char* >( characters.data() ) -
+                   reinterpret_cast< const char* >( origin );
+    lengths[ i ] = static_cast< int64_t >( characters.size() );
+  }
+
+  const __m256i normal_mask = _mm256_set1_epi64x(
+    static_cast< int64_t >( Character::PACKED_NORMAL ) );
+  const __m256i folded_case_mask = _mm256_set1_epi64x(
+    static_cast< int64_t >( Character::PACKED_FOLDED_CASE ) );
+  const __m256i last_query_index = _mm256_set1_epi64x( query_length - 1 );
+  const __m256i length = _mm256_load_si256(
+    reinterpret_cast< const __m256i* >( lengths.data() ) );
+  const __m256i step = _mm256_set1_epi64x( sizeof( uint64_t ) );
+  const auto *normal = reinterpret_cast< const long long* >(
+    query.normal.data() );
+  const auto *folded_case = reinterpret_cast< const long long* >(
+    query.folded_case.data() );
+  const auto *base_mask = reinterpret_cast< const long long* >(
+    query.base_mask.data() );
+  const auto *base = reinterpret_cast< const long long* >( query.base.data() );
+
+  __m256i offset = _mm256_load_si256(
+    reinterpret_cast< const __m256i* >( offsets.data() ) );
+  __m256i query_index = _mm256_setzero_si256();
+  __m256i index_sum = _mm256_setzero_si256();
+  __m256i matched = _mm256_setzero_si256();
+  __m256i prefix = _mm256_setzero_si256();
+  // Candidates which are shorter than the query can't match.
+  __m256i active = _mm256_cmpgt_epi64(
+    length, _mm256_set1_epi64x( query_length - 1 ) );
+
+  for ( int64_t index = 0; !_mm256_testz_si256( active, active ); ++index ) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i character = _mm256_mask_i64gather_epi64(
+      zero, origin, offset, active, 1 );
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_cmpeq_epi64(
+          _mm256_and_si256( character, normal_mask ),
+          _mm256_mask_i64gather_epi64( zero, normal, query_index, active, 8 ) ),
+        _mm256_cmpeq_epi64(
+          _mm256_and_si256( character, folded_case_mask ),
+          _mm256_mask_i64gather_epi64(
+            zero, folded_case, query_index, active, 8 ) ) ),
+      _mm256_cmpeq_epi64(
+        _mm256_and_si256(
+          character,
+          _mm256_mask_i64gather_epi64(
+            zero, base_mask, query_index, active, 8 ) ),
+        _mm256_mask_i64gather_epi64( zero, base, query_index, active, 8 ) ) );
+    hit = _mm256_and_si256( hit, active );
+
+    const __m256i candidate_index = _mm256_set1_epi64x( index );
+    index_sum = _mm256_add_epi64( index_sum,
+                                  _mm256_and_si256( hit, candidate_index ) );
+    __m256i done = _mm256_and_si256(
+      hit, _mm256_cmpeq_epi64( query_index, last_query_index ) );
+    prefix = _mm256_or_si256(
+      prefix,
+      _mm256_and_si256( done,
+                        _mm256_cmpeq_epi64( query_index, candidate_index ) ) );
+    matched = _mm256_or_si256( matched, done );
+    // Hits are all ones, i.e. -1.
+    query_index = _mm256_sub_epi64( query_index, hit );
+    offset = _mm256_add_epi64( offset, step );
+
+    // Lanes which have matched, or have no characters left, stop.
+    active = _mm256_andnot_si256( done, active );
+    active = _mm256_and_si256(
+      active,
+      _mm256_cmpgt_epi64( length, _mm256_set1_epi64x( index + 1 ) ) );
+  }
+
+  alignas( 32 ) std::array< int64_t, 4 > matched_lanes;
+  alignas( 32 ) std::array< int64_t, 4 > prefix_lanes;
+  alignas( 32 ) std::array< int64_t, 4 > index_sums;
+  _mm256_store_si256( reinterpret_cast< __m256i* >( matched_lanes.data() ),
+                      matched );
+  _mm256_store_si256( reinterpret_cast< __m256i* >( prefix_lanes.data() ),
+                      prefix );
+  _mm256_store_si256( reinterpret_cast< __m256i* >( index_sums.data() ),
+                      index_sum );
+  for ( size_t i = 0; i < num_candidates; ++i ) {
+    if ( matched_lanes[ i ] ) {
+      matches[ i ] = { true,
+                       prefix_lanes[ i ] != 0,
+                       static_cast< uint32_t >( index_sums[ i ] ) };
+    } else {
+      matches[ i ] = {};
+    }
+  }
+}
+
+
+__attribute__(( target( "avx2" ) ))
+void MatchBatchAvx2( const QueryMatcher::PackedQuery &query,
+                     const Candidate* const* candidates,
+                     size_t num_candidates,
+                     CandidateMatch* matches ) {
+  for ( size_t first = 0; first < num_candidates; first += 4 ) {
+    MatchFourAvx2( query,
+                   candidates + first,
+                   std::min< size_t >( 4, num_candidates - first ),
+                   matches + first );
+  }
+}
+
+#endif // YCM_QUERY_MATCHER_X86
+
+
+MatchFunction SelectMatchBatch() {
+#ifdef YCM_QUERY_MATCHER_X86
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    return &MatchBatchAvx2;
+  }
+#endif
+  return &MatchBatchScalar;
+}
+
+
+CandidateMatch ToCandidateMatch( const Result &result ) {
+  return { result.IsSubsequence(),
+           result.QueryIsCandidatePrefix(),
+           static_cast< uint32_t >( result.CharMatchIndexSum() ) };
+}
+
+} // unnamed namespace
+
+
+QueryMatcher::QueryMatcher( const Word &query )
+  : query_( query ),
+    packed_( query.PackedCharacters().size() == query.Length() ) {
+  if ( !packed_ ) {
+    return;
+  }
+
+  const auto &characters = query.Characters();
+  const auto &packed_characters = query.PackedCharacters();
+  for ( size_t i = 0; i < characters.size(); ++i ) {
+    uint64_t packed = packed_characters[ i ];
+    bool is_uppercase = characters[ i ]->IsUppercase();
+    uint64_t uppercase = is_uppercase ? Character::PACKED_UPPERCASE : 0;
+
+    packed_query_.normal.push_back( packed & Character::PACKED_NORMAL );
+    packed_query_.folded_case.push_back(
+      is_uppercase ? NO_MATCH : packed & Character::PACKED_FOLDED_CASE );
+    // An uppercase character only matches an uppercase base.
+    packed_query_.base_mask.push_back( Character::PACKED_BASE | uppercase );
+    packed_query_.base.push_back(
+      characters[ i ]->IsBase()
+      ? ( packed & Character::PACKED_BASE ) | uppercase
+      : NO_MATCH );
+  }
+}
+
+
+void QueryMatcher::Match( std::span< const Candidate* const > candidates,
+                          CandidateMatch* matches ) const {
+  static const MatchFunction match_batch = SelectMatchBatch();
+
+  if ( query_.IsEmpty() || !packed_ ) {
+    for ( size_t i = 0; i < candidates.size(); ++i ) {
+      matches[ i ] = ToCandidateMatch(
+        candidates[ i ]->QueryMatchResult( query_ ) );
+    }
+    return;
+  }
+
+  // Candidates which couldn't be packed are matched on their own; the rest are
+  // matched together.
+  std::array< const Candidate*, BATCH_SIZE > packed_candidates;
+  std::array< size_t, BATCH_SIZE > packed_indices;
+  size_t num_packed = 0;
+  for ( size_t i = 0; i < candidates.size(); ++i ) {
+    if ( candidates[ i ]->PackedCharacters().size() ==
+         candidates[ i ]->Length() ) {
+      packed_candidates[ num_packed ] = candidates[ i ];
+      packed_indices[ num_packed++ ] = i;
+    } else {
+      matches[ i ] = ToCandidateMatch(
+        candidates[ i ]->QueryMatchResult( query_ ) );
+    }
+  }
+  if ( num_packed == 0 ) {
+    return;
+  }
+
+  std::array< CandidateMatch, BATCH_SIZE > packed_matches;
+  match_batch( packed_query_,
+               packed_candidates.data(),
+               num_packed,
+               packed_matches.data() );
+  for ( size_t i = 0; i < num_packed; ++i ) {
+    matches[ packed_indices[ i ] ] = packed_matches[ i ];
+  }
+}
+
+} // namespace YouCompleteMe
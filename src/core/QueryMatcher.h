@@ -0,0 +1,102 @@
+// Copyright (C) 2021 ycmd contributors
+//
+// This file is part of ycmd.
+//
+// ycmd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ycmd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef QUERYMATCHER_H_P4XN8TLE
+#define QUERYMATCHER_H_P4XN8TLE
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace YouCompleteMe {
+
+class Candidate;
+class Word;
+
+// Whether a query is a subsequence of a candidate, and where it matched, as
+// worked out by Candidate::QueryMatchResult.
+struct CandidateMatch {
+  bool is_subsequence = false;
+  bool query_is_candidate_prefix = false;
+  uint32_t char_match_index_sum = 0;
+};
+
+
+// Matches a query against batches of candidates, using their packed characters
+// (see Character::Packed) rather than their strings. With AVX2, 4 candidates
+// are matched at once, each walking its own characters and the query's; the
+// results are the same as Candidate::QueryMatchResult's.
+//
+// Words which couldn't be packed are matched with
+// Candidate::QueryMatchResult.
+class QueryMatcher {
+public:
+  static constexpr size_t BATCH_SIZE = 8;
+
+  YCM_EXPORT explicit QueryMatcher( const Word &query );
+  QueryMatcher( const QueryMatcher& ) = delete;
+  QueryMatcher& operator=( const QueryMatcher& ) = delete;
+
+  // Fills matches[ i ] in for candidates[ i ]. There can be up to BATCH_SIZE
+  // candidates.
+  YCM_EXPORT void Match( std::span< const Candidate* const > candidates,
+                         CandidateMatch* matches ) const;
+
+  // Calls f( i, match ) for each of the candidates which the query matches,
+  // where i is the candidate's index in candidates. They are matched
+  // BATCH_SIZE at a time.
+  template< typename F >
+  void ForEachMatch( std::span< const Candidate* const > candidates,
+                     F&& f ) const {
+    std::array< CandidateMatch, BATCH_SIZE > matches;
+    for ( size_t first = 0; first < candidates.size(); first += BATCH_SIZE ) {
+      auto batch = candidates.subspan(
+        first, std::min( BATCH_SIZE, candidates.size() - first ) );
+      Match( batch, matches.data() );
+      for ( size_t i = 0; i < batch.size(); ++i ) {
+        if ( matches[ i ].is_subsequence ) {
+          f( first + i, matches[ i ] );
+        }
+      }
+    }
+  }
+
+  // What the query's characters are compared with, for each of them: a
+  // candidate's character matches if
+  //   ( packed & Character::PACKED_NORMAL ) == normal[ i ] or
+  //   ( packed & Character::PACKED_FOLDED_CASE ) == folded_case[ i ] or
+  //   ( packed & base_mask[ i ] ) == base[ i ]
+  // which is Character::MatchesSmart. Comparisons which don't apply to a
+  // character are given a value which can't match.
+  struct PackedQuery {
+    std::vector< uint64_t > normal;
+    std::vector< uint64_t > folded_case;
+    std::vector< uint64_t > base_mask;
+    std::vector< uint64_t > base;
+  };
+
+private:
+  const Word &query_;
+  bool packed_;
+  PackedQuery packed_query_;
+};
+
+} // namespace YouCompleteMe
+
+#endif /* end of include guard: QUERYMATCHER_H_P4XN8TLE */
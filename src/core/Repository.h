@@ -21,10 +21,12 @@
 #include "Candidate.h"
 #include "Character.h"
 #include "CodePoint.h"
+#include "SlabArena.h"
 #include "Utils.h"
 
 #ifdef YCM_ABSEIL_SUPPORTED
 #include <absl/container/flat_hash_map.h>
+#include <absl/strings/string_view.h>
 namespace YouCompleteMe {
 template< typename K, typename V >
 using HashMap = absl::flat_hash_map< K, V >;
@@ -36,9 +38,17 @@ template< typename K, typename V >
 using HashMap = std::unordered_map< K, V >;
 } // namespace YouCompleteMe
 #endif
-#include <memory>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <mutex>
+#include <new>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace YouCompleteMe {
@@ -46,11 +56,26 @@ namespace YouCompleteMe {
 // This singleton stores already built T objects. If Ts are requested for
 // previously unseen strings, new T objects are built.
 //
+// The elements are spread over a number of shards by hash, each with its own
+// lock, so that threads building candidates at the same time rarely contend.
+// New elements are built outside of the lock; if two threads race to build the
+// same one, the loser's copy is thrown away. Characters and code points are
+// looked up far more often than they are added, so each thread also keeps a
+// small cache of those in front of the shards.
+//
+// The elements themselves live in a slab arena, in the order they were added,
+// and the shards' tables only map a view of each element's text to it.
+//
+// Elements which are kept for a long time (e.g. the identifier database's) are
+// acquired, and released when they are no longer needed. Once the repository
+// uses more than its memory budget, Trim throws away elements which nobody has
+// acquired, least recently used first (roughly). Pointers returned by
+// GetElements are only borrowed, and must not be used after the next Trim.
+//
 // This class is thread-safe.
 template< typename T >
 class Repository {
 public:
-  using Holder = HashMap< std::string, std::unique_ptr< T > >;
   using Sequence = std::vector< const T* >;
   static Repository &Instance() {
     static Repository repo;
@@ -61,52 +86,456 @@ public:
   Repository& operator=( const Repository& ) = delete;
 
   size_t NumStoredElements() const {
-    // std::shared_lock locker( element_holder_mutex_ );
-    return element_holder_.size();
+    return num_elements_.load( std::memory_order_relaxed );
+  }
+
+  // An estimate of the memory used by the elements and their keys.
+  size_t MemoryUsage() const {
+    return bytes_.load( std::memory_order_relaxed );
+  }
+
+  size_t MemoryBudget() const {
+    return budget_.load( std::memory_order_relaxed );
+  }
+
+  // Zero means no limit, which is the default.
+  void SetMemoryBudget( size_t bytes ) {
+    budget_.store( bytes, std::memory_order_relaxed );
   }
 
   Sequence GetElements(
     std::vector< std::string >&& elements ) {
-    Sequence element_objects( elements.size() );
-    auto it = element_objects.begin();
-  
-    {
-      //std::lock_guard locker( element_holder_mutex_ );
-  
-      for ( auto&& element : elements ) {
-        if constexpr ( std::is_same_v< T, Candidate > ) {
-          if ( element.size() > 80 ) {
-            element = "";
-          }
+    return LookUpElements< false >( elements );
+  }
+
+  // Same as above, but for callers which have views into a larger buffer (e.g.
+  // a whole file). A string is only allocated for previously unseen elements.
+  Sequence GetElements(
+    const std::vector< std::string_view >& elements ) {
+    return LookUpElements< false >( elements );
+  }
+
+  // Same as GetElements, but the elements are kept by Trim until they are
+  // released. Each acquisition needs its own release.
+  Sequence AcquireElements(
+    std::vector< std::string >&& elements ) {
+    return LookUpElements< true >( elements );
+  }
+
+  Sequence AcquireElements(
+    const std::vector< std::string_view >& elements ) {
+    return LookUpElements< true >( elements );
+  }
+
+  // Elements are found by their text, so equal elements which didn't come from
+  // the repository will do. Releasing something which isn't there is ignored.
+  void ReleaseElements( const Sequence& elements )
+    requires std::is_same_v< T, Candidate > {
+    for ( const T* element : elements ) {
+      HashedElement hashed{ element->Text(), HashElement( element->Text() ) };
+      Shard &shard = shards_[ ShardIndex( hashed ) ];
+      std::shared_lock locker( shard.mutex );
+      if ( auto it = shard.holder.find( hashed ); it != shard.holder.end() ) {
+        [[maybe_unused]] auto references =
+          it->second->references.fetch_sub( 1, std::memory_order_relaxed );
+        assert( references > 0 );
+      }
+    }
+  }
+
+  // If the repository is over budget, destroys unacquired elements until it is
+  // comfortably under again, and returns how many were destroyed. Nothing may be
+  // using borrowed elements (on any thread) at the time; in the server it is
+  // called on the I/O thread between requests.
+  size_t Trim() {
+    size_t budget = MemoryBudget();
+    if ( budget == 0 || MemoryUsage() <= budget ) {
+      return 0;
+    }
+
+    // Leave some room, so that we don't end up trimming after every request.
+    size_t target = budget - budget / 4;
+    size_t num_destroyed = 0;
+
+    // Elements which have been used since the last Trim get a second chance,
+    // and are only destroyed if that isn't enough.
+    for ( bool second_chance : { true, false } ) {
+      for ( auto& shard : shards_ ) {
+        if ( MemoryUsage() <= target ) {
+          break;
         }
-        std::unique_ptr< T > &element_object = GetValueElseInsert(
-                                                           element_holder_,
-                                                           element,
-                                                           nullptr );
-  
-        if ( !element_object ) {
-          element_object = std::make_unique< T >( std::move( element ) );
+        std::lock_guard locker( shard.mutex );
+        for ( auto it = shard.holder.begin(); it != shard.holder.end(); ) {
+          Entry &entry = *it->second;
+          if ( MemoryUsage() <= target ||
+               ( second_chance &&
+                 entry.used.exchange( false, std::memory_order_relaxed ) ) ||
+               entry.references.load( std::memory_order_relaxed ) > 0 ) {
+            ++it;
+            continue;
+          }
+          shard.holder.erase( it++ );
+          DestroyEntry( &entry );
+          ++num_destroyed;
         }
-  
-        *it++ = element_object.get();
       }
     }
-  
-    return element_objects;
+
+    generation_.fetch_add( 1, std::memory_order_release );
+    return num_destroyed;
   }
 
-  // This should only be used to isolate tests and benchmarks.
+  // This should only be used to isolate tests and benchmarks, and nothing may
+  // be using the elements (on any thread) at the time.
   void ClearElements() {
-    element_holder_.clear();
+    for ( auto& shard : shards_ ) {
+      std::lock_guard locker( shard.mutex );
+      for ( const auto& [ _, entry ] : shard.holder ) {
+        DestroyEntry( entry );
+      }
+      shard.holder.clear();
+    }
+    generation_.fetch_add( 1, std::memory_order_release );
   }
 
 private:
   Repository() = default;
-  ~Repository() = default;
+  ~Repository() {
+    ClearElements();
+  }
+
+  static constexpr size_t NUM_SHARDS = 64;
+  static constexpr bool USE_THREAD_CACHE = !std::is_same_v< T, Candidate >;
+  static constexpr size_t MAX_THREAD_CACHE_SIZE = 4096;
+
+  static size_t HashElement( std::string_view element ) {
+#ifdef YCM_ABSEIL_SUPPORTED
+    return absl::Hash< absl::string_view >{}(
+      absl::string_view( element.data(), element.size() ) );
+#else
+    return std::hash< std::string_view >{}( element );
+#endif
+  }
+
+  // An element being looked up, with its hash, which is needed to pick the
+  // shard as well as to look it up in there.
+  struct HashedElement {
+    std::string_view text;
+    size_t hash;
+  };
+
+  struct ElementHash {
+    using is_transparent = void;
+    size_t operator()( std::string_view element ) const {
+      return HashElement( element );
+    }
+    size_t operator()( const HashedElement& element ) const {
+      return element.hash;
+    }
+  };
+
+  struct ElementEqual {
+    using is_transparent = void;
+    bool operator()( std::string_view a, std::string_view b ) const {
+      return a == b;
+    }
+    bool operator()( const HashedElement& a, std::string_view b ) const {
+      return a.text == b;
+    }
+    bool operator()( std::string_view a, const HashedElement& b ) const {
+      return a == b.text;
+    }
+  };
+
+  // A view of an element's key -> V, which can also be looked up with a
+  // HashedElement without hashing again
+  template< typename V >
+#ifdef YCM_ABSEIL_SUPPORTED
+  using ElementMap = absl::flat_hash_map< std::string_view,
+                                          V,
+                                          ElementHash,
+                                          ElementEqual >;
+#else
+  using ElementMap = std::unordered_map< std::string_view,
+                                         V,
+                                         ElementHash,
+                                         ElementEqual >;
+#endif
+
+  // A candidate's text is its key. Characters and code points are normalised,
+  // so need to keep the key separately, but it's only a few bytes.
+  static constexpr bool KEY_IS_TEXT = std::is_same_v< T, Candidate >;
+  struct NoKey {};
+  using Key = std::conditional_t< KEY_IS_TEXT, NoKey, std::string >;
+
+  static Key MakeKey( std::string_view text ) {
+    if constexpr ( KEY_IS_TEXT ) {
+      return {};
+    } else {
+      return Key( text );
+    }
+  }
+
+  struct Entry {
+    explicit Entry( std::string_view text )
+      : key( MakeKey( text ) ),
+        element( std::string( text ) ) {
+    }
+
+    std::string_view Key() const {
+      if constexpr ( KEY_IS_TEXT ) {
+        return element.Text();
+      } else {
+        return key;
+      }
+    }
+
+    [[no_unique_address]] Repository::Key key;
+    T element;
+    // Acquisitions which haven't been released yet
+    std::atomic< uint32_t > references = 0;
+    // Whether the element has been looked up since the last Trim
+    std::atomic< bool > used = true;
+    size_t bytes = 0;
+  };
+  using Holder = ElementMap< Entry* >;
+
+  struct alignas( 64 ) Shard {
+    mutable std::shared_mutex mutex;
+    Holder holder;
+  };
+
+  // Elements seen by this thread, which can be returned without touching the
+  // shards. It is thrown away when the repository is cleared, or when it gets
+  // too big.
+  struct ThreadCache {
+    ElementMap< const T* > elements;
+    uint64_t generation = 0;
+  };
+
+  // The hash tables use the low bits of the hash, so the shard is picked with
+  // the high bits.
+  static size_t ShardIndex( const HashedElement& element ) {
+    constexpr int SHARD_BITS = std::countr_zero( NUM_SHARDS );
+    return static_cast< uint64_t >( element.hash ) >> ( 64 - SHARD_BITS );
+  }
+
+  static std::string_view ElementText( std::string_view element ) {
+    if constexpr ( std::is_same_v< T, Candidate > ) {
+      if ( element.size() > 80 ) {
+        return {};
+      }
+    }
+    return element;
+  }
+
+  // What malloc adds to each allocation, roughly.
+  static constexpr size_t ALLOCATION_OVERHEAD = 16;
+
+  // Strings short enough to be stored inline don't use any more.
+  static size_t HeapBytes( const std::string& text ) {
+    return text.capacity() > std::string().capacity()
+           ? text.capacity() + 1 + ALLOCATION_OVERHEAD
+           : 0;
+  }
+
+  template< typename V >
+  static size_t HeapBytes( const std::vector< V >& elements ) {
+    return elements.capacity()
+           ? elements.capacity() * sizeof( V ) + ALLOCATION_OVERHEAD
+           : 0;
+  }
+
+  // Characters and code points are a few bytes each, so are stored inline.
+  static size_t EntryBytes( const Entry& entry ) {
+    size_t bytes = sizeof( typename Holder::value_type ) + sizeof( Entry );
+    if constexpr ( std::is_same_v< T, Candidate > ) {
+      const T &element = entry.element;
+      bytes += HeapBytes( element.Text() ) +
+               HeapBytes( element.CaseSwappedText() ) +
+               HeapBytes( element.Characters() ) +
+               HeapBytes( element.PackedCharacters() ) +
+               HeapBytes( element.WordBoundaryChars() );
+    }
+    return bytes;
+  }
+
+  Entry* NewEntry( std::string_view text ) {
+    Entry *storage;
+    {
+      std::lock_guard locker( arena_mutex_ );
+      storage = arena_.Allocate();
+    }
+    try {
+      return new ( storage ) Entry( text );
+    } catch ( ... ) {
+      std::lock_guard locker( arena_mutex_ );
+      arena_.Deallocate( storage );
+      throw;
+    }
+  }
+
+  // Destroys an entry which isn't (or is no longer) in any shard.
+  void DeleteEntry( Entry* entry ) {
+    entry->~Entry();
+    std::lock_guard locker( arena_mutex_ );
+    arena_.Deallocate( entry );
+  }
+
+  // Destroys an entry which has just been removed from its shard.
+  void DestroyEntry( Entry* entry ) {
+    num_elements_.fetch_sub( 1, std::memory_order_relaxed );
+    bytes_.fetch_sub( entry->bytes, std::memory_order_relaxed );
+    DeleteEntry( entry );
+  }
+
+  // The shard's lock must be held.
+  static const T* UseEntry( Entry& entry, bool acquire ) {
+    if ( acquire ) {
+      entry.references.fetch_add( 1, std::memory_order_relaxed );
+    }
+    // Avoid dirtying the cache line when it's already set.
+    if ( !entry.used.load( std::memory_order_relaxed ) ) {
+      entry.used.store( true, std::memory_order_relaxed );
+    }
+    return &entry.element;
+  }
+
+  template< bool ACQUIRE, typename Elements >
+  Sequence LookUpElements( const Elements& elements ) {
+    Sequence element_objects( elements.size() );
+
+    if constexpr ( USE_THREAD_CACHE && !ACQUIRE ) {
+      for ( size_t i = 0; i < elements.size(); ++i ) {
+        element_objects[ i ] = GetElement( ElementText( elements[ i ] ) );
+      }
+      return element_objects;
+    } else {
+      // Visit the shards in turn, so that each lock is only taken once per
+      // call rather than once per element.
+      std::vector< HashedElement > hashed;
+      hashed.reserve( elements.size() );
+      std::array< size_t, NUM_SHARDS + 1 > shard_starts{};
+      for ( const auto& element : elements ) {
+        auto text = ElementText( element );
+        hashed.push_back( { text, HashElement( text ) } );
+        ++shard_starts[ ShardIndex( hashed.back() ) + 1 ];
+      }
+      for ( size_t shard = 0; shard < NUM_SHARDS; ++shard ) {
+        shard_starts[ shard + 1 ] += shard_starts[ shard ];
+      }
+      std::vector< size_t > by_shard( elements.size() );
+      auto next = shard_starts;
+      for ( size_t i = 0; i < hashed.size(); ++i ) {
+        by_shard[ next[ ShardIndex( hashed[ i ] ) ]++ ] = i;
+      }
+
+      std::vector< size_t > missing;
+      for ( size_t shard = 0; shard < NUM_SHARDS; ++shard ) {
+        if ( shard_starts[ shard ] == shard_starts[ shard + 1 ] ) {
+          continue;
+        }
+        const Holder &holder = shards_[ shard ].holder;
+        std::shared_lock locker( shards_[ shard ].mutex );
+        for ( size_t j = shard_starts[ shard ];
+              j < shard_starts[ shard + 1 ];
+              ++j ) {
+          size_t i = by_shard[ j ];
+          if ( auto it = holder.find( hashed[ i ] ); it != holder.end() ) {
+            element_objects[ i ] = UseEntry( *it->second, ACQUIRE );
+          } else {
+            missing.push_back( i );
+          }
+        }
+      }
+
+      // Add them in the order they were asked for, so that they are laid out
+      // that way in the arena.
+      std::sort( missing.begin(), missing.end() );
+      for ( size_t i : missing ) {
+        element_objects[ i ] = AddElement( hashed[ i ], ACQUIRE );
+      }
+      return element_objects;
+    }
+  }
+
+  const T* GetElement( std::string_view element ) {
+    if constexpr ( USE_THREAD_CACHE ) {
+      thread_local ThreadCache cache;
+      auto generation = generation_.load( std::memory_order_acquire );
+      if ( cache.generation != generation ||
+           cache.elements.size() >= MAX_THREAD_CACHE_SIZE ) {
+        cache.elements.clear();
+        cache.generation = generation;
+      }
+      if ( auto cached = cache.elements.find( element );
+           cached != cache.elements.end() ) {
+        return cached->second;
+      }
+      // The key stays valid for as long as the element, and the cache is
+      // thrown away before anything else once any elements are destroyed.
+      const Entry *entry = GetSharedEntry( element );
+      cache.elements.try_emplace( entry->Key(), &entry->element );
+      return &entry->element;
+    } else {
+      return &GetSharedEntry( element )->element;
+    }
+  }
+
+  const Entry* GetSharedEntry( std::string_view text ) {
+    HashedElement element{ text, HashElement( text ) };
+    Shard &shard = shards_[ ShardIndex( element ) ];
+    {
+      std::shared_lock locker( shard.mutex );
+      if ( auto it = shard.holder.find( element );
+           it != shard.holder.end() ) {
+        UseEntry( *it->second, false );
+        return it->second;
+      }
+    }
+    return AddEntry( element, false );
+  }
+
+  const T* AddElement( const HashedElement& element, bool acquire ) {
+    return &AddEntry( element, acquire )->element;
+  }
+
+  const Entry* AddEntry( const HashedElement& element, bool acquire ) {
+    // Building a T can be expensive (and can itself use other repositories),
+    // so don't hold the lock while doing it.
+    Entry *entry = NewEntry( element.text );
+
+    Shard &shard = shards_[ ShardIndex( element ) ];
+    Entry *existing;
+    {
+      std::lock_guard locker( shard.mutex );
+      auto it = shard.holder.find( element );
+      if ( it == shard.holder.end() ) {
+        shard.holder.emplace( entry->Key(), entry );
+        entry->bytes = EntryBytes( *entry );
+        num_elements_.fetch_add( 1, std::memory_order_relaxed );
+        bytes_.fetch_add( entry->bytes, std::memory_order_relaxed );
+        UseEntry( *entry, acquire );
+        return entry;
+      }
+
+      // Another thread got there first.
+      existing = it->second;
+      UseEntry( *existing, acquire );
+    }
+    DeleteEntry( entry );
+    return existing;
+  }
 
-  // This data structure owns all the T pointers
-  Holder element_holder_;
-  // mutable std::shared_mutex element_holder_mutex_;
+  // Elements are allocated from here, and the shards own them.
+  SlabArena< Entry > arena_;
+  std::mutex arena_mutex_;
+  std::array< Shard, NUM_SHARDS > shards_;
+  // Bumped whenever elements are destroyed, to invalidate the thread caches
+  std::atomic< uint64_t > generation_ = 0;
+  std::atomic< size_t > num_elements_ = 0;
+  std::atomic< size_t > bytes_ = 0;
+  std::atomic< size_t > budget_ = 0;
 };
 
 extern template class YCM_EXPORT Repository< Candidate >;
@@ -18,60 +18,187 @@
 #include "Result.h"
 #include "Utils.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
 namespace YouCompleteMe {
 
 namespace {
 
-size_t LongestCommonSubsequenceLength( const CharacterSequence &first,
-                                       const CharacterSequence &second ) {
-  const auto &longer  = first.size() > second.size() ? first  : second;
-  const auto &shorter = first.size() > second.size() ? second : first;
+// Up to this many characters, the shorter of the two sequences and the LCS's
+// state are kept on the stack.
+constexpr size_t MAX_SMALL_LCS_LENGTH = 256;
 
-  size_t longer_len  = longer.size();
-  size_t shorter_len = shorter.size();
+// The bit-parallel algorithm of Allison and Dix, as simplified by Hyyrö: bit i
+// of the row is clear for each i where the LCS of the characters of longer so
+// far and shorter[ 0..i ] is one longer than for shorter[ 0..i-1 ], so the
+// number of clear bits is the length of the LCS. Each character of longer
+// updates the whole row with an addition, 64 characters of shorter at a time.
+//
+// equal( i, character ) compares shorter[ i ] with a character of longer.
+template< typename Equal >
+size_t BitParallelLcsLength( const CharacterSequence &shorter,
+                             const CharacterSequence &longer,
+                             Equal &&equal ) {
+  constexpr size_t WORD_BITS = 64;
+  size_t num_words = ( shorter.size() + WORD_BITS - 1 ) / WORD_BITS;
 
-  std::vector< size_t > previous( shorter_len + 1, 0 );
-  std::vector< size_t > current(  shorter_len + 1, 0 );
+  // Word boundary characters and queries rarely get anywhere near this long.
+  std::array< uint64_t, MAX_SMALL_LCS_LENGTH / WORD_BITS > small_row;
+  std::vector< uint64_t > large_row;
+  uint64_t *row = small_row.data();
+  if ( num_words > small_row.size() ) {
+    large_row.resize( num_words );
+    row = large_row.data();
+  }
+  std::fill( row, row + num_words, ~uint64_t{ 0 } );
 
-  for ( size_t i = 0; i < longer_len; ++i ) {
-    for ( size_t j = 0; j < shorter_len; ++j ) {
-      if ( longer[ i ]->EqualsBase( *shorter[ j ] ) ) {
-        current[ j + 1 ] = previous[ j ] + 1;
-      } else {
-        current[ j + 1 ] = std::max( current[ j ], previous[ j + 1 ] );
+  for ( const Character *character : longer ) {
+    uint64_t carry = 0;
+    for ( size_t word = 0; word < num_words; ++word ) {
+      size_t first = word * WORD_BITS;
+      size_t last = std::min( first + WORD_BITS, shorter.size() );
+      uint64_t matches = 0;
+      for ( size_t i = first; i < last; ++i ) {
+        matches |= static_cast< uint64_t >( equal( i, character ) ) <<
+                   ( i - first );
       }
-    }
 
-    for ( size_t j = 0; j < shorter_len; ++j ) {
-      previous[ j + 1 ] = current[ j + 1 ];
+      uint64_t bits = row[ word ];
+      uint64_t matched_bits = bits & matches;
+      uint64_t sum = bits + matched_bits;
+      uint64_t next_carry = sum < bits;
+      sum += carry;
+      next_carry |= sum < carry;
+      row[ word ] = sum | ( bits & ~matches );
+      carry = next_carry;
     }
   }
 
-  return current[ shorter_len ];
+  size_t length = 0;
+  for ( size_t word = 0; word < num_words; ++word ) {
+    size_t bits_in_word = std::min( WORD_BITS,
+                                    shorter.size() - word * WORD_BITS );
+    uint64_t valid = bits_in_word == WORD_BITS
+                     ? ~uint64_t{ 0 }
+                     : ( uint64_t{ 1 } << bits_in_word ) - 1;
+    length += static_cast< size_t >( std::popcount( ~row[ word ] & valid ) );
+  }
+  return length;
 }
 
 
+bool AllPacked( const CharacterSequence &characters ) {
+  return std::none_of( characters.begin(),
+                       characters.end(),
+                       []( const Character *character ) {
+                         return character->Packed() == Character::NOT_PACKED;
+                       } );
+}
+
 } // unnamed namespace
 
+
+size_t LongestCommonSubsequenceLength( const CharacterSequence &first,
+                                       const CharacterSequence &second ) {
+  const auto &longer  = first.size() > second.size() ? first  : second;
+  const auto &shorter = first.size() > second.size() ? second : first;
+
+  if ( shorter.empty() ) {
+    return 0;
+  }
+
+  // Characters have equal bases when their packed base IDs are equal. Those of
+  // shorter are looked up once, rather than for each character of longer.
+  if ( shorter.size() <= MAX_SMALL_LCS_LENGTH &&
+       AllPacked( shorter ) &&
+       AllPacked( longer ) ) {
+    std::array< uint64_t, MAX_SMALL_LCS_LENGTH > bases;
+    for ( size_t i = 0; i < shorter.size(); ++i ) {
+      bases[ i ] = shorter[ i ]->Packed() & Character::PACKED_BASE;
+    }
+    return BitParallelLcsLength(
+      shorter,
+      longer,
+      [ &bases ]( size_t i, const Character *character ) {
+        return bases[ i ] == ( character->Packed() & Character::PACKED_BASE );
+      } );
+  }
+
+  return BitParallelLcsLength(
+    shorter,
+    longer,
+    [ &shorter ]( size_t i, const Character *character ) {
+      return shorter[ i ]->EqualsBase( *character );
+    } );
+}
+
+
 Result::Result( const Candidate *candidate,
                 const Word *query,
                 size_t char_match_index_sum,
                 bool query_is_candidate_prefix )
+  : Result( candidate,
+            query,
+            char_match_index_sum,
+            query_is_candidate_prefix,
+            UpperBoundTag() ) {
+  ComputeWordBoundaryMatches();
+}
+
+
+Result::Result( const Candidate *candidate,
+                const Word *query,
+                size_t char_match_index_sum,
+                bool query_is_candidate_prefix,
+                UpperBoundTag )
   : is_subsequence_( true ),
     first_char_same_in_query_and_text_( false ),
     query_is_candidate_prefix_( query_is_candidate_prefix ),
     char_match_index_sum_( char_match_index_sum ),
     num_wb_matches_( 0 ),
+    sort_key_( 0 ),
+    sort_key_is_exact_( true ),
     candidate_( candidate ),
     query_( query ) {
   SetResultFeaturesFromQuery();
+  ComputeSortKey();
+}
+
+
+Result Result::UpperBound( const Candidate *candidate,
+                           const Word *query,
+                           size_t char_match_index_sum,
+                           bool query_is_candidate_prefix ) {
+  return Result( candidate,
+                 query,
+                 char_match_index_sum,
+                 query_is_candidate_prefix,
+                 UpperBoundTag() );
+}
+
+
+bool Result::LessWithEqualSortKeys( const Result &other ) const {
+  if ( !sort_key_is_exact_ ) {
+    return LessByFeatures( other );
+  }
+
+  // The results have the same features, so their texts decide.
+  uint64_t prefix = candidate_->CaseSwappedTextPrefix();
+  uint64_t other_prefix = other.candidate_->CaseSwappedTextPrefix();
+  if ( prefix != other_prefix ) {
+    return prefix < other_prefix;
+  }
+  return candidate_->CaseSwappedText() < other.candidate_->CaseSwappedText();
 }
 
 
-bool Result::operator< ( const Result &other ) const {
-  // Yes, this is ugly but it also needs to be fast.  Since this is called a
-  // bazillion times, we have to make sure only the required comparisons are
-  // made, and no more.
+bool Result::LessByFeatures( const Result &other ) const {
+  // The ranking, feature by feature. It's only needed when the sort keys are
+  // equal but couldn't fit all of the features; see ComputeSortKey.
 
   if ( !query_->IsEmpty() ) {
     // This is the core of the ranking system. A result has more weight than
@@ -148,8 +275,58 @@ void Result::SetResultFeaturesFromQuery() {
   first_char_same_in_query_and_text_ =
     candidate_->Characters()[ 0 ]->EqualsBase( *query_->Characters()[ 0 ] );
 
+  // All else being equal, a result ranks higher the more word boundary
+  // characters it matches (see operator<), and it can't match more of them
+  // than the candidate has or the query is long.
+  num_wb_matches_ = std::min( query_->Length(),
+                              candidate_->WordBoundaryChars().size() );
+}
+
+
+void Result::ComputeWordBoundaryMatches() {
+  if ( query_->IsEmpty() || candidate_->IsEmpty() ) {
+    return;
+  }
+
   num_wb_matches_ = LongestCommonSubsequenceLength(
     query_->Characters(), candidate_->WordBoundaryChars() );
+  ComputeSortKey();
+}
+
+
+void Result::ComputeSortKey() {
+  sort_key_ = 0;
+  sort_key_is_exact_ = true;
+  if ( !query_ || query_->IsEmpty() ) {
+    return;
+  }
+
+  // The features are appended in the order LessByFeatures compares them, as
+  // values which are lower for the better result.
+  auto append = [ this ]( uint64_t value, int bits ) {
+    uint64_t max_value = ( uint64_t{ 1 } << bits ) - 1;
+    sort_key_ <<= bits;
+    if ( sort_key_is_exact_ ) {
+      sort_key_ |= std::min( value, max_value );
+      sort_key_is_exact_ = value < max_value;
+    }
+  };
+  auto append_flag = [ this ]( bool flag ) {
+    sort_key_ = ( sort_key_ << 1 ) | ( sort_key_is_exact_ && flag );
+  };
+
+  // Results which match all of the query's characters on word boundaries come
+  // first, by their number of word boundary characters, then the others.
+  bool all_wb_matched = num_wb_matches_ == query_->Length();
+  append_flag( !first_char_same_in_query_and_text_ );
+  append_flag( !all_wb_matched );
+  append( all_wb_matched ? NumWordBoundaryChars() : 0, 8 );
+  append_flag( !query_is_candidate_prefix_ );
+  append( query_->Length() - num_wb_matches_, 8 );
+  append( NumWordBoundaryChars(), 8 );
+  append( char_match_index_sum_, 22 );
+  append( candidate_->Length(), 14 );
+  append_flag( !candidate_->TextIsLowercase() );
 }
 
 } // namespace YouCompleteMe
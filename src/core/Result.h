@@ -20,7 +20,12 @@
 
 #include "Candidate.h"
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace YouCompleteMe {
 
@@ -32,6 +37,8 @@ public:
     query_is_candidate_prefix_( false ),
     char_match_index_sum_( 0 ),
     num_wb_matches_( 0 ),
+    sort_key_( 0 ),
+    sort_key_is_exact_( true ),
     candidate_( nullptr ),
     query_( nullptr ) {}
 
@@ -40,7 +47,32 @@ public:
           size_t char_match_index_sum,
           bool query_is_candidate_prefix );
 
-  bool operator< ( const Result &other ) const;
+  // Same as above, but leaves out the number of word boundary characters the
+  // query matches, which is the expensive part. Until
+  // ComputeWordBoundaryMatches() is called, the result takes it to be as high
+  // as it could be, so it compares at least as well as the complete result
+  // would. A result which this doesn't make good enough needn't be completed.
+  static Result UpperBound( const Candidate *candidate,
+                            const Word *query,
+                            size_t char_match_index_sum,
+                            bool query_is_candidate_prefix );
+
+  void ComputeWordBoundaryMatches();
+
+  // Results are mostly ordered by their sort keys alone; see ComputeSortKey.
+  inline bool operator< ( const Result &other ) const {
+    if ( sort_key_ != other.sort_key_ ) {
+      return sort_key_ < other.sort_key_;
+    }
+    return LessWithEqualSortKeys( other );
+  }
+
+  // Orders the results like operator<, as far as it goes: if a result's key is
+  // lower than another's, it comes first. Results with equal keys need
+  // operator< to tell them apart.
+  inline uint64_t SortKey() const {
+    return sort_key_;
+  }
 
   inline const std::string &Text() const {
     return candidate_->Text();
@@ -54,8 +86,27 @@ public:
     return is_subsequence_;
   }
 
+  inline bool QueryIsCandidatePrefix() const {
+    return query_is_candidate_prefix_;
+  }
+
+  inline size_t CharMatchIndexSum() const {
+    return char_match_index_sum_;
+  }
+
 private:
+  struct UpperBoundTag {};
+
+  Result( const Candidate *candidate,
+          const Word *query,
+          size_t char_match_index_sum,
+          bool query_is_candidate_prefix,
+          UpperBoundTag );
+
   void SetResultFeaturesFromQuery();
+  void ComputeSortKey();
+  bool LessWithEqualSortKeys( const Result &other ) const;
+  bool LessByFeatures( const Result &other ) const;
 
   // true when the characters of the query are a subsequence of the characters
   // in the candidate text, e.g. the characters "abc" are a subsequence for
@@ -86,6 +137,13 @@ private:
   //  - the character is a letter and the previous one is a punctuation.
   size_t num_wb_matches_;
 
+  // The features above, packed so that comparing keys compares the results,
+  // unless they have the same key. Once a feature is too large for its bits,
+  // those of the features after it are left at zero, and the key isn't exact:
+  // results with equal keys must then be compared feature by feature.
+  uint64_t sort_key_;
+  bool sort_key_is_exact_;
+
   // NOTE: we don't use references for the query and the candidate because we
   // are sorting results through std::sort or std::partial_sort and these
   // functions require move assignments which is not possible with reference
@@ -109,10 +167,127 @@ struct ResultAnd {
     return result_ < other.result_;
   }
 
+  uint64_t SortKey() const {
+    return result_.SortKey();
+  }
+
   T extra_object_;
   Result result_;
 };
 
+// The length of the longest common subsequence of the two sequences, where
+// characters are equal if their bases are.
+YCM_EXPORT size_t LongestCommonSubsequenceLength(
+  const CharacterSequence &first,
+  const CharacterSequence &second );
+
+// Sorts elements (results, or ResultAnd) from best to worst: by their sort
+// keys, a byte at a time, skipping the bytes which are the same for all of the
+// elements, then each run of elements with equal keys with operator<.
+template< typename Element >
+void RadixSortResults( std::vector< Element > &elements ) {
+  using KeyAndIndex = std::pair< uint64_t, size_t >;
+  std::vector< KeyAndIndex > keys;
+  keys.reserve( elements.size() );
+  for ( size_t i = 0; i < elements.size(); ++i ) {
+    keys.emplace_back( elements[ i ].SortKey(), i );
+  }
+
+  std::vector< KeyAndIndex > sorted_keys( keys.size() );
+  for ( int shift = 0; shift < 64; shift += 8 ) {
+    std::array< size_t, 256 > offsets{};
+    for ( const auto &[ key, _ ] : keys ) {
+      ++offsets[ ( key >> shift ) & 0xFF ];
+    }
+    if ( std::find( offsets.begin(), offsets.end(), keys.size() ) !=
+         offsets.end() ) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for ( auto &count : offsets ) {
+      offset += std::exchange( count, offset );
+    }
+    for ( const auto &key : keys ) {
+      sorted_keys[ offsets[ ( key.first >> shift ) & 0xFF ]++ ] = key;
+    }
+    keys.swap( sorted_keys );
+  }
+
+  std::vector< Element > sorted;
+  sorted.reserve( elements.size() );
+  for ( const auto &[ _, index ] : keys ) {
+    sorted.push_back( std::move( elements[ index ] ) );
+  }
+
+  using Difference = typename std::vector< Element >::difference_type;
+  for ( size_t first = 0; first < keys.size(); ) {
+    size_t last = first + 1;
+    while ( last < keys.size() && keys[ last ].first == keys[ first ].first ) {
+      ++last;
+    }
+    if ( last - first > 1 ) {
+      std::sort( sorted.begin() + static_cast< Difference >( first ),
+                 sorted.begin() + static_cast< Difference >( last ) );
+    }
+    first = last;
+  }
+  elements = std::move( sorted );
+}
+
+
+// Keeps the max_results best elements it's given, or all of them if
+// max_results is 0. Once it has max_results, they are kept in a heap with the
+// worst of them on top, so an element only has to be compared with that one.
+//
+// An element can be checked with CouldKeep() before it's complete, e.g. with
+// Result::UpperBound(), and only completed and added if it passes.
+template< typename Element >
+class TopResults {
+public:
+  explicit TopResults( size_t max_results )
+    : max_results_( max_results ) {
+  }
+
+  bool CouldKeep( const Element &element ) const {
+    return max_results_ == 0 ||
+           elements_.size() < max_results_ ||
+           element < elements_.front();
+  }
+
+  void Add( Element element ) {
+    if ( max_results_ == 0 || elements_.size() < max_results_ ) {
+      elements_.push_back( std::move( element ) );
+      if ( elements_.size() == max_results_ ) {
+        std::make_heap( elements_.begin(), elements_.end() );
+      }
+    } else if ( element < elements_.front() ) {
+      std::pop_heap( elements_.begin(), elements_.end() );
+      elements_.back() = std::move( element );
+      std::push_heap( elements_.begin(), elements_.end() );
+    }
+  }
+
+  // The elements which were kept, best first.
+  std::vector< Element > Take() {
+    if ( elements_.size() >= MIN_RADIX_SORT_SIZE ) {
+      RadixSortResults( elements_ );
+    } else if ( max_results_ > 0 && elements_.size() == max_results_ ) {
+      std::sort_heap( elements_.begin(), elements_.end() );
+    } else {
+      std::sort( elements_.begin(), elements_.end() );
+    }
+    return std::move( elements_ );
+  }
+
+private:
+  // Below this, comparison sorts are faster.
+  static constexpr size_t MIN_RADIX_SORT_SIZE = 256;
+
+  size_t max_results_;
+  std::vector< Element > elements_;
+};
+
 } // namespace YouCompleteMe
 
 #endif /* end of include guard: RESULT_H_CZYD2SGN */
@@ -0,0 +1,91 @@
+// Copyright (C) 2021 ycmd contributors
+//
+// This file is part of ycmd.
+//
+// ycmd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ycmd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ycmd.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SLABARENA_H_Q2M8VXK4
+#define SLABARENA_H_Q2M8VXK4
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace YouCompleteMe {
+
+// Storage for Ts, allocated in chunks of about 64KiB. Objects allocated one
+// after the other are next to each other in memory, there is no per-object
+// allocation overhead, and addresses never change. Freed slots are reused by
+// later allocations, but chunks are only given back to the system when the
+// arena is destroyed.
+//
+// The arena only hands out storage; constructing and destroying the objects in
+// it is up to the caller, so that it can be done outside of any lock protecting
+// the arena.
+//
+// This class is not thread-safe.
+template< typename T >
+class SlabArena {
+public:
+  SlabArena() = default;
+  SlabArena( const SlabArena& ) = delete;
+  SlabArena& operator=( const SlabArena& ) = delete;
+
+  // Returns uninitialised storage for a T.
+  T* Allocate() {
+    if ( free_ ) {
+      Slot *slot = free_;
+      free_ = slot->next_free;
+      return reinterpret_cast< T* >( slot->storage );
+    }
+
+    if ( chunks_.empty() || used_in_last_chunk_ == CHUNK_SIZE ) {
+      chunks_.push_back( std::make_unique_for_overwrite< Slot[] >(
+        CHUNK_SIZE ) );
+      used_in_last_chunk_ = 0;
+    }
+    return reinterpret_cast< T* >(
+      chunks_.back()[ used_in_last_chunk_++ ].storage );
+  }
+
+  // Takes back storage from Allocate, once the T in it has been destroyed.
+  void Deallocate( T* storage ) {
+    Slot *slot = reinterpret_cast< Slot* >( storage );
+    slot->next_free = free_;
+    free_ = slot;
+  }
+
+  // The memory held by the arena, whether in use or not.
+  size_t Capacity() const {
+    return chunks_.size() * CHUNK_SIZE * sizeof( Slot );
+  }
+
+private:
+  union Slot {
+    Slot *next_free;
+    alignas( T ) unsigned char storage[ sizeof( T ) ];
+  };
+
+  static constexpr size_t CHUNK_SIZE =
+    std::max< size_t >( 1, 65536 / sizeof( Slot ) );
+
+  std::vector< std::unique_ptr< Slot[] > > chunks_;
+  size_t used_in_last_chunk_ = 0;
+  Slot *free_ = nullptr;
+};
+
+} // namespace YouCompleteMe
+
+#endif /* end of include guard: SLABARENA_H_Q2M8VXK4 */
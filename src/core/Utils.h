@@ -20,6 +20,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <limits>
 #include <string>
@@ -46,6 +48,27 @@ YCM_EXPORT inline char Lowercase( uint8_t ascii_character ) {
 }
 
 
+// Whether none of the bytes has its most significant bit set, checked 8 bytes
+// at a time.
+YCM_EXPORT inline bool IsAscii( std::string_view text ) {
+  constexpr uint64_t HIGH_BITS = 0x8080808080808080;
+  size_t i = 0;
+  for ( ; i + sizeof( uint64_t ) <= text.size(); i += sizeof( uint64_t ) ) {
+    uint64_t bytes;
+    std::memcpy( &bytes, text.data() + i, sizeof( uint64_t ) );
+    if ( bytes & HIGH_BITS ) {
+      return false;
+    }
+  }
+  for ( ; i < text.size(); ++i ) {
+    if ( static_cast< uint8_t >( text[ i ] ) & 0x80 ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
 YCM_EXPORT inline std::string Lowercase( std::string_view text ) {
   std::string result( text.size(), '\0' );
   std::transform( text.begin(),
@@ -60,7 +83,8 @@ YCM_EXPORT inline std::string Lowercase( std::string_view text ) {
 
 // Reads the entire contents of the specified file. If the file does not exist,
 // an exception is thrown.
-std::vector< std::string > ReadUtf8File( const fs::path &filepath );
+YCM_EXPORT std::vector< std::string > ReadUtf8File(
+  const fs::path &filepath );
 
 
 template <class Container, class Key, typename Value>
@@ -17,279 +17,424 @@
 
 #include "Repository.h"
 #include "CodePoint.h"
+#include "Utils.h"
 #include "Word.h"
 
+#include <algorithm>
+#include <array>
+#include <mutex>
 #include <string>
 
 namespace YouCompleteMe {
 
 namespace {
 
-// Break a sequence of code points into characters (grapheme clusters) according
-// to the rules in
+// The bit of Word::BytesPresentMask for each byte
+constexpr std::array< uint8_t, NUM_BYTES > BYTE_MASK_BITS = [] {
+  std::array< uint8_t, NUM_BYTES > bits{};
+  for ( size_t byte = 0; byte < NUM_BYTES; ++byte ) {
+    if ( 'a' <= byte && byte <= 'z' ) {
+      bits[ byte ] = static_cast< uint8_t >( byte - 'a' );
+    } else if ( 'A' <= byte && byte <= 'Z' ) {
+      bits[ byte ] = static_cast< uint8_t >( byte - 'A' );
+    } else if ( '0' <= byte && byte <= '9' ) {
+      bits[ byte ] = static_cast< uint8_t >( 26 + byte - '0' );
+    } else if ( byte == '_' ) {
+      bits[ byte ] = 36;
+    } else if ( byte < 0x80 ) {
+      bits[ byte ] = static_cast< uint8_t >( 37 + byte % 11 );
+    } else {
+      bits[ byte ] = static_cast< uint8_t >( 48 + byte % 16 );
+    }
+  }
+  return bits;
+}();
+
+constexpr size_t NUM_ASCII_CHARACTERS = 128;
+
+// The character for each ASCII byte, looked up once. They are acquired so that
+// they outlive any trimming of the repository.
+const std::array< const Character*, NUM_ASCII_CHARACTERS > &AsciiCharacters() {
+  static const auto characters = [] {
+    std::vector< std::string > texts;
+    for ( size_t byte = 0; byte < NUM_ASCII_CHARACTERS; ++byte ) {
+      texts.emplace_back( 1, static_cast< char >( byte ) );
+    }
+    CharacterSequence sequence =
+      Repository< Character >::Instance().AcquireElements( std::move( texts ) );
+
+    std::array< const Character*, NUM_ASCII_CHARACTERS > table;
+    std::copy( sequence.begin(), sequence.end(), table.begin() );
+    return table;
+  }();
+  return characters;
+}
+
+
+// Each ASCII byte is a character of its own, except for CR followed by LF
+// (rule GB3 below), so such text needn't be broken into code points first.
+bool IsAsciiWithoutCrLf( std::string_view text ) {
+  return IsAscii( text ) && text.find( "\r\n" ) == std::string_view::npos;
+}
+
+
+// What the grapheme cluster boundary rules need to know about the code points
+// before a boundary. See
 // https://www.unicode.org/reports/tr29/tr29-37.html#Grapheme_Cluster_Boundary_Rules
-std::vector< std::string > BreakCodePointsIntoCharacters(
-  const CodePointSequence &code_points ) {
+enum BreakState : uint8_t {
+  AFTER_OTHER,
+  AFTER_CR,
+  // Also the state at the start of the text, which is always a break.
+  AFTER_CONTROL_OR_LF,
+  AFTER_L,
+  AFTER_V_OR_LV,
+  AFTER_T_OR_LVT,
+  AFTER_PREPEND,
+  AFTER_EXTEND,
+  AFTER_ZWJ,
+  // ExtPict Extend*
+  AFTER_EXTPICT,
+  // ExtPict Extend* ZWJ
+  AFTER_EXTPICT_ZWJ,
+  // An odd number of regional indicators
+  AFTER_ODD_RI,
+  AFTER_EVEN_RI,
+  NUM_BREAK_STATES
+};
+
+constexpr size_t NUM_BREAK_PROPERTIES =
+  static_cast< size_t >( BreakProperty::EXTPICT ) + 1;
+
+// Set in a transition when there is a boundary before the code point.
+constexpr uint8_t BREAK_BEFORE = 0x80;
+
+
+constexpr bool IsBoundary( BreakState state, BreakProperty property ) {
+  using enum BreakProperty;
+  switch ( state ) {
+    // Rule GB3: do not break between a CR and LF.
+    // Rule GB4: otherwise, break after controls, CR and LF.
+    case AFTER_CR:
+      return property != LF;
+    case AFTER_CONTROL_OR_LF:
+      return true;
+    default:
+      break;
+  }
+
+  switch ( property ) {
+    // Rule GB5: break before controls, CR and LF.
+    case CONTROL:
+    case CR:
+    case LF:
+      return true;
+    // Rule GB9: do not break before extending characters or when using a
+    // zero-width joiner (ZWJ).
+    // Rule GB9a: do not break before spacing marks.
+    case EXTEND:
+    case ZWJ:
+    case SPACINGMARK:
+      return false;
+    default:
+      break;
+  }
 
-  std::vector< std::string > characters;
+  switch ( state ) {
+    // Rule GB6: do not break Hangul syllable sequences.
+    case AFTER_L:
+      return property != L && property != V &&
+             property != LV && property != LVT;
+    // Rule GB7: do not break Hangul syllable sequences.
+    case AFTER_V_OR_LV:
+      return property != V && property != T;
+    // Rule GB8: do not break Hangul syllable sequences.
+    case AFTER_T_OR_LVT:
+      return property != T;
+    // Rule GB9b: do not break after prepend characters.
+    case AFTER_PREPEND:
+      return false;
+    // Rule GB11: do not break within emoji modifier sequences or emoji zwj
+    // sequences.
+    case AFTER_EXTPICT_ZWJ:
+      return property != EXTPICT;
+    // Rules GB12 and GB13: do not break within emoji flag sequences. That is,
+    // do not break between regional indicator (RI) symbols if there is an odd
+    // number of RI characters before the break point.
+    case AFTER_ODD_RI:
+      return property != REGIONAL_INDICATOR;
+    // Rule GB999: otherwise, break everywhere.
+    default:
+      return true;
+  }
+}
 
-  // Rules GB1 and GB2 (break at the start and at the end of the text) are
-  // automatically satisfied.
 
-  auto code_point_pos = code_points.begin();
-  if ( code_point_pos == code_points.end() ) {
-    return characters;
+constexpr BreakState NextBreakState( BreakState state,
+                                     BreakProperty property ) {
+  using enum BreakProperty;
+  switch ( property ) {
+    case CR:
+      return AFTER_CR;
+    case CONTROL:
+    case LF:
+      return AFTER_CONTROL_OR_LF;
+    case L:
+      return AFTER_L;
+    case V:
+    case LV:
+      return AFTER_V_OR_LV;
+    case T:
+    case LVT:
+      return AFTER_T_OR_LVT;
+    case PREPEND:
+      return AFTER_PREPEND;
+    case EXTEND:
+      return state == AFTER_EXTPICT ? AFTER_EXTPICT : AFTER_EXTEND;
+    case ZWJ:
+      return state == AFTER_EXTPICT ? AFTER_EXTPICT_ZWJ : AFTER_ZWJ;
+    case EXTPICT:
+      return AFTER_EXTPICT;
+    case REGIONAL_INDICATOR:
+      return state == AFTER_ODD_RI ? AFTER_EVEN_RI : AFTER_ODD_RI;
+    default:
+      return AFTER_OTHER;
   }
+}
 
-  std::string character;
-  character.append( ( *code_point_pos )->Normal() );
 
-  auto previous_code_point_pos = code_point_pos;
-  ++code_point_pos;
-  if ( code_point_pos == code_points.end() ) {
-    characters.push_back( character );
-    return characters;
+// The state after each code point and whether it starts a character, from the
+// state before it and its break property: next state | BREAK_BEFORE.
+constexpr auto BREAK_TRANSITIONS = [] {
+  std::array< std::array< uint8_t, NUM_BREAK_PROPERTIES >, NUM_BREAK_STATES >
+    transitions{};
+  for ( size_t state = 0; state < NUM_BREAK_STATES; ++state ) {
+    for ( size_t property = 0; property < NUM_BREAK_PROPERTIES; ++property ) {
+      auto break_state = static_cast< BreakState >( state );
+      auto break_property = static_cast< BreakProperty >( property );
+      transitions[ state ][ property ] = static_cast< uint8_t >(
+        NextBreakState( break_state, break_property ) |
+        ( IsBoundary( break_state, break_property ) ? BREAK_BEFORE : 0 ) );
+    }
   }
+  return transitions;
+}();
 
-  bool is_regional_indicator_nb_odd = false;
-  bool within_emoji_modifier = false;
-
-  for ( ; code_point_pos != code_points.end() ; ++previous_code_point_pos,
-                                                ++code_point_pos ) {
-    auto previous_property = ( *previous_code_point_pos )->GetBreakProperty();
-    const auto &code_point = ( *code_point_pos )->Normal();
-    auto property = ( *code_point_pos )->GetBreakProperty();
-
-    switch( previous_property ) {
-      case BreakProperty::CR:
-        switch( property ) {
-          // Rule GB3: do not break between a CR and LF.
-          case BreakProperty::LF:
-            character.append( code_point );
-            break;
-          // Rule GB4: otherwise, break after CR.
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
-        break;
-      // Rule GB4: break after controls and LF.
-      case BreakProperty::CONTROL:
-      case BreakProperty::LF:
-        characters.push_back( character );
-        character = code_point;
-        break;
-      case BreakProperty::L:
-        switch( property ) {
-          // Rule GB6: do not break Hangul syllable sequences.
-          case BreakProperty::L:
-          case BreakProperty::V:
-          case BreakProperty::LV:
-          case BreakProperty::LVT:
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
-        break;
-      case BreakProperty::LV:
-      case BreakProperty::V:
-        switch( property ) {
-          // Rule GB7: do not break Hangul syllable sequences.
-          case BreakProperty::V:
-          case BreakProperty::T:
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
-        break;
-      case BreakProperty::LVT:
-      case BreakProperty::T:
-        switch( property ) {
-          // Rule GB8: do not break Hangul syllable sequences.
-          case BreakProperty::T:
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
-        break;
-      case BreakProperty::PREPEND:
-        switch( property ) {
-          // Rules GB5: break before controls.
-          case BreakProperty::CONTROL:
-          case BreakProperty::CR:
-          case BreakProperty::LF:
-            characters.push_back( character );
-            character = code_point;
-            break;
-          // Rule GB9b: do not break after prepend characters.
-          default:
-            character.append( code_point );
-        }
-        break;
-      case BreakProperty::EXTEND:
-        switch( property ) {
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-            character.append( code_point );
-            break;
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            within_emoji_modifier = false;
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-            within_emoji_modifier = false;
-        }
-        break;
-      case BreakProperty::ZWJ:
-        switch( property ) {
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            within_emoji_modifier = false;
-            break;
-          // Rule GB11: do not break within emoji modifier sequences of emoji
-          // zwj sequences.
-          case BreakProperty::EXTPICT:
-            if ( within_emoji_modifier ) {
-              character.append( code_point );
-              within_emoji_modifier = false;
-            } else {
-              characters.push_back( character );
-              character = code_point;
-            }
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-            within_emoji_modifier = false;
-        }
-        break;
-      case BreakProperty::EXTPICT:
-        switch( property ) {
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            break;
-          // Rule GB11: do not break within emoji modifier sequences of emoji
-          // zwj sequences.
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-            character.append( code_point );
-            within_emoji_modifier = true;
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
-        break;
-      case BreakProperty::REGIONAL_INDICATOR:
-        switch( property ) {
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            is_regional_indicator_nb_odd = false;
-            break;
-          // Rules GB12 and GB13: do not break within emoji flag sequences. That
-          // is, do not break between regional indicator (RI) symbols if there
-          // is an odd number of RI characters before the break point.
-          case BreakProperty::REGIONAL_INDICATOR:
-            is_regional_indicator_nb_odd = !is_regional_indicator_nb_odd;
-            if ( is_regional_indicator_nb_odd ) {
-              character.append( code_point );
-            } else {
-              characters.push_back( character );
-              character = code_point;
-            }
-            break;
-          default:
-            characters.push_back( character );
-            character = code_point;
-            is_regional_indicator_nb_odd = false;
-        }
-        break;
-      default:
-        switch( property ) {
-          // Rule GB9: do not break before extending characters or when using a
-          // zero-width joiner (ZWJ).
-          case BreakProperty::EXTEND:
-          case BreakProperty::ZWJ:
-          // Rule GB9a: do not break before spacing marks.
-          case BreakProperty::SPACINGMARK:
-            character.append( code_point );
-            break;
-          // Rules GB5: break before controls.
-          // Rules GB999.
-          default:
-            characters.push_back( character );
-            character = code_point;
-        }
+
+// Break a sequence of code points into characters (grapheme clusters). Rules
+// GB1 and GB2 (break at the start and at the end of the text) are satisfied by
+// starting after a control and ending the last character with the text.
+//
+// Characters are made of normalized code points, so they are views into text
+// if it's normalized already, which it mostly is, and into normal_text, which
+// is filled with its normalization, if not.
+std::vector< std::string_view > BreakCodePointsIntoCharacters(
+  std::string_view text,
+  const CodePointSequence &code_points,
+  std::string &normal_text ) {
+
+  // The offsets of the characters in the normalized text
+  std::vector< size_t > starts;
+  bool is_normal = true;
+  size_t offset = 0;
+  uint8_t state = AFTER_CONTROL_OR_LF;
+  for ( const CodePoint *code_point : code_points ) {
+    const std::string &normal = code_point->Normal();
+    auto property = static_cast< size_t >( code_point->GetBreakProperty() );
+    state = BREAK_TRANSITIONS[ state & ~BREAK_BEFORE ][ property ];
+    if ( state & BREAK_BEFORE ) {
+      starts.push_back( offset );
+    }
+    is_normal = is_normal && text.compare( offset, normal.size(), normal ) == 0;
+    offset += normal.size();
+  }
+  starts.push_back( offset );
+
+  if ( !is_normal ) {
+    normal_text.reserve( offset );
+    for ( const CodePoint *code_point : code_points ) {
+      normal_text.append( code_point->Normal() );
     }
+    text = normal_text;
   }
 
-  characters.push_back( character );
+  std::vector< std::string_view > characters;
+  characters.reserve( starts.size() - 1 );
+  for ( size_t i = 0; i + 1 < starts.size(); ++i ) {
+    characters.push_back( text.substr( starts[ i ],
+                                       starts[ i + 1 ] - starts[ i ] ) );
+  }
   return characters;
 }
 
+
+// How many of the most recent queries QueryWord keeps
+constexpr size_t NUM_RECENT_QUERIES = 16;
+
 } // unnamed namespace
 
 void Word::BreakIntoCharacters() {
+  if ( IsAsciiWithoutCrLf( text_ ) ) {
+    const auto &ascii_characters = AsciiCharacters();
+    characters_.reserve( text_.size() );
+    for ( auto byte : text_ ) {
+      characters_.push_back(
+        ascii_characters[ static_cast< uint8_t >( byte ) ] );
+    }
+    return;
+  }
+
   const CodePointSequence &code_points = BreakIntoCodePoints( text_ );
 
+  std::string normal_text;
   characters_ = Repository< Character >::Instance().GetElements(
-    BreakCodePointsIntoCharacters( code_points ) );
+    BreakCodePointsIntoCharacters( text_, code_points, normal_text ) );
 }
 
 
 void Word::ComputeBytesPresent() {
+  // The base of ASCII text is its lowercase.
+  if ( IsAscii( text_ ) ) {
+    for ( auto byte : text_ ) {
+      auto base = static_cast< uint8_t >(
+        Lowercase( static_cast< uint8_t >( byte ) ) );
+      bytes_present_.set( base );
+      bytes_present_mask_ |= uint64_t{ 1 } << BYTE_MASK_BITS[ base ];
+    }
+    return;
+  }
+
   for ( const auto &character : characters_ ) {
     for ( auto byte : character->Base() ) {
       bytes_present_.set( static_cast< uint8_t >( byte ) );
+      bytes_present_mask_ |=
+        uint64_t{ 1 } << BYTE_MASK_BITS[ static_cast< uint8_t >( byte ) ];
     }
   }
 }
 
 
+void Word::ComputePackedCharacters() {
+  packed_characters_.reserve( characters_.size() );
+  for ( const auto &character : characters_ ) {
+    if ( character->Packed() == Character::NOT_PACKED ) {
+      packed_characters_.clear();
+      packed_characters_.shrink_to_fit();
+      return;
+    }
+    packed_characters_.push_back( character->Packed() );
+  }
+}
+
+
 Word::Word( std::string_view text )
   : text_( text ) {
   BreakIntoCharacters();
   ComputeBytesPresent();
+  ComputePackedCharacters();
+}
+
+
+Word::Word( const Word &prefix, std::string_view suffix )
+  : text_( prefix.text_ ) {
+  text_.append( suffix );
+
+  // Only non-ASCII characters (and CR LF) take more than a byte, so prefix is
+  // ASCII if it has as many characters as bytes. Then, unless suffix starts
+  // with the LF of a CR LF, the characters of prefix don't change.
+  bool crlf = !prefix.text_.empty() && prefix.text_.back() == '\r' &&
+              !suffix.empty() && suffix.front() == '\n';
+  if ( prefix.Length() != prefix.text_.size() ||
+       crlf ||
+       !IsAsciiWithoutCrLf( suffix ) ) {
+    BreakIntoCharacters();
+    ComputeBytesPresent();
+    ComputePackedCharacters();
+    return;
+  }
+
+  const auto &ascii_characters = AsciiCharacters();
+  characters_.reserve( text_.size() );
+  characters_.insert( characters_.end(),
+                      prefix.characters_.begin(),
+                      prefix.characters_.end() );
+  bytes_present_ = prefix.bytes_present_;
+  bytes_present_mask_ = prefix.bytes_present_mask_;
+  for ( auto byte : suffix ) {
+    characters_.push_back(
+      ascii_characters[ static_cast< uint8_t >( byte ) ] );
+    auto base = static_cast< uint8_t >(
+      Lowercase( static_cast< uint8_t >( byte ) ) );
+    bytes_present_.set( base );
+    bytes_present_mask_ |= uint64_t{ 1 } << BYTE_MASK_BITS[ base ];
+  }
+  // Characters which come after one that couldn't be packed aren't either.
+  if ( prefix.packed_characters_.size() != prefix.Length() ) {
+    return;
+  }
+  packed_characters_.reserve( characters_.size() );
+  packed_characters_.insert( packed_characters_.end(),
+                             prefix.packed_characters_.begin(),
+                             prefix.packed_characters_.end() );
+  for ( size_t i = prefix.Length(); i < characters_.size(); ++i ) {
+    if ( characters_[ i ]->Packed() == Character::NOT_PACKED ) {
+      packed_characters_.clear();
+      packed_characters_.shrink_to_fit();
+      return;
+    }
+    packed_characters_.push_back( characters_[ i ]->Packed() );
+  }
+}
+
+
+std::shared_ptr< const Word > QueryWord( std::string_view text ) {
+  // Most recent first
+  static std::mutex mutex;
+  static std::vector< std::shared_ptr< const Word > > recent_words;
+
+  // Returns the recent word with this text, if there is one, and makes it the
+  // most recent. The lock must be held.
+  auto find_recent = [ &text ]() -> std::shared_ptr< const Word > {
+    for ( auto it = recent_words.begin(); it != recent_words.end(); ++it ) {
+      if ( ( *it )->Text() == text ) {
+        std::rotate( recent_words.begin(), it, it + 1 );
+        return recent_words.front();
+      }
+    }
+    return nullptr;
+  };
+
+  std::shared_ptr< const Word > prefix;
+  {
+    std::lock_guard locker( mutex );
+    if ( auto word = find_recent() ) {
+      return word;
+    }
+    for ( const auto &recent_word : recent_words ) {
+      const std::string &recent_text = recent_word->Text();
+      if ( text.starts_with( recent_text ) &&
+           ( !prefix || recent_text.size() > prefix->Text().size() ) ) {
+        prefix = recent_word;
+      }
+    }
+  }
+
+  // Building the word is the expensive part, so other threads can look up
+  // their queries meanwhile.
+  auto word = prefix
+    ? std::make_shared< const Word >( *prefix,
+                                      text.substr( prefix->Text().size() ) )
+    : std::make_shared< const Word >( text );
+
+  std::lock_guard locker( mutex );
+  // Another thread may have built the same word meanwhile.
+  if ( auto recent_word = find_recent() ) {
+    return recent_word;
+  }
+  if ( recent_words.size() == NUM_RECENT_QUERIES ) {
+    recent_words.pop_back();
+  }
+  recent_words.insert( recent_words.begin(), word );
+  return word;
 }
 
 } // namespace YouCompleteMe
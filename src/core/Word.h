@@ -21,7 +21,10 @@
 #include "Character.h"
 
 #include <bitset>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define NUM_BYTES 256
@@ -37,6 +40,9 @@ using Bitset = std::bitset< NUM_BYTES >;
 class Word {
 public:
   YCM_EXPORT explicit Word( std::string_view text );
+  // The word for prefix's text followed by suffix. The characters of prefix
+  // are reused when they can't change, i.e. when both are ASCII.
+  YCM_EXPORT Word( const Word &prefix, std::string_view suffix );
   // Make class noncopyable
 protected:
   Word( const Word& ) = default;
@@ -68,15 +74,39 @@ public:
     return characters_.empty();
   }
 
+  // The bytes present, folded into 64 bits. Each identifier character (ASCII
+  // letter, digit or underscore) has a bit of its own; the other bytes share
+  // the rest. So if a word contains the bytes from another word, its mask
+  // contains the other word's mask, though not necessarily the other way round.
+  inline uint64_t BytesPresentMask() const {
+    return bytes_present_mask_;
+  }
+
+  // The characters' Character::Packed, or nothing if any of them couldn't be
+  // packed.
+  inline const std::vector< uint64_t > &PackedCharacters() const {
+    return packed_characters_;
+  }
+
 private:
   void BreakIntoCharacters();
   void ComputeBytesPresent();
+  void ComputePackedCharacters();
 
   std::string text_;
   CharacterSequence characters_;
+  std::vector< uint64_t > packed_characters_;
   Bitset bytes_present_;
+  uint64_t bytes_present_mask_ = 0;
 };
 
+
+// Returns the word for a query. The words of the last few queries are kept, so
+// that a repeated query gets the same word back, and one which extends a
+// recent query (as when it's typed a character at a time) is built from it.
+// This function is thread-safe.
+YCM_EXPORT std::shared_ptr< const Word > QueryWord( std::string_view text );
+
 } // namespace YouCompleteMe
 
 #endif /* end of include guard: WORD_H_UOHAUKVQ */
@@ -33,6 +33,7 @@
 
 #include "core/Candidate.h"
 #include "core/IdentifierCompleter.h"
+#include "core/QueryMatcher.h"
 #include "core/Repository.h"
 #include "core/Result.h"
 
@@ -123,9 +124,12 @@ namespace ycmd::handlers {
       ycm::Repository<ycm::Candidate>::Instance().GetElements(
         std::move( strings ) );
 
-    std::vector< ycm::ResultAnd< size_t > > result_and_objects;
-    ycm::Word query_object( std::move( request_data.query ) );
+    auto query_word = ycm::QueryWord( request_data.query );
+    const ycm::Word& query_object = *query_word;
+    ycm::QueryMatcher matcher( query_object );
 
+    std::vector< const ycm::Candidate* > possible_candidates;
+    std::vector< size_t > possible_indices;
     for ( size_t i = 0; i < repository_candidates.size(); ++i )
     {
       const ycm::Candidate *candidate = repository_candidates[ i ];
@@ -135,15 +139,31 @@ namespace ycmd::handlers {
         continue;
       }
 
-      ycm::Result result = candidate->QueryMatchResult( query_object );
-
-      if ( result.IsSubsequence() )
-      {
-        result_and_objects.emplace_back( result, i );
-      }
+      possible_candidates.push_back( candidate );
+      possible_indices.push_back( i );
     }
-    constexpr auto MAX_CANDIDATES = 0;
-    ycm::PartialSort( result_and_objects, MAX_CANDIDATES );
+
+    // Only the candidates which could make it into the best max_num_candidates
+    // have their word boundary matches worked out.
+    size_t max_candidates = static_cast< size_t >(
+      std::max( server.user_options.value( "max_num_candidates", 0 ), 0 ) );
+    ycm::TopResults< ycm::ResultAnd< size_t > > top_results( max_candidates );
+    matcher.ForEachMatch(
+      possible_candidates,
+      [ & ]( size_t i, const ycm::CandidateMatch& match ) {
+        ycm::ResultAnd< size_t > result_and_object(
+          ycm::Result::UpperBound( possible_candidates[ i ],
+                                   &query_object,
+                                   match.char_match_index_sum,
+                                   match.query_is_candidate_prefix ),
+          possible_indices[ i ] );
+        if ( top_results.CouldKeep( result_and_object ) )
+        {
+          result_and_object.result_.ComputeWordBoundaryMatches();
+          top_results.Add( result_and_object );
+        }
+      } );
+    auto result_and_objects = top_results.Take();
 
     std::vector<json> filtered_candidates;
     filtered_candidates.reserve( result_and_objects.size() );
@@ -153,6 +173,7 @@ namespace ycmd::handlers {
         request_data.candidates[ r.extra_object_ ] );
     }
 
+    server.trim_candidates();
     co_return api::json_response( filtered_candidates );
   }
 
@@ -208,6 +229,7 @@ namespace ycmd::handlers {
       server.filename_completer.handle_event_notification( request_wrap.req )
     );
 
+    server.trim_candidates();
     co_return api::json_response( json::object() );
   }
 
@@ -288,6 +310,17 @@ namespace ycmd::handlers {
     co_return api::json_response( "" );
   }
 
+  template< typename T >
+  responses::DebugInfoResponse::RepositoryUsage repository_usage()
+  {
+    const auto& repository = YouCompleteMe::Repository<T>::Instance();
+    return {
+      .num_elements = repository.NumStoredElements(),
+      .bytes = repository.MemoryUsage(),
+      .budget_bytes = repository.MemoryBudget(),
+    };
+  }
+
   Result handle_debug_info( server::server& server, const Request& req )
   {
     auto request_wrap = ycmd::make_request_wrap( req );
@@ -298,6 +331,11 @@ namespace ycmd::handlers {
       .python{
         .executable = py::str( sys.attr( "executable" ) ),
         .version{ py::str( sys.attr( "version" ) ) }
+      },
+      .repositories{
+        .candidates = repository_usage<YouCompleteMe::Candidate>(),
+        .characters = repository_usage<YouCompleteMe::Character>(),
+        .code_points = repository_usage<YouCompleteMe::CodePoint>(),
       }
     };
 
@@ -0,0 +1,708 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#include <unicode/uchar.h>
+#include <unicode/utf8.h>
+
+#include "byte_classifier.cpp"
+
+// Identifier definitions are written as (a small subset of) regular
+// expressions, but rather than handing them to a regex engine, they are
+// compiled at compile time into DFAs over a tiny alphabet. Each definition gets
+// a forward DFA (for lexing) and a reverse DFA, which lets us find the start of
+// the identifier ending at the cursor in a single backwards pass.
+//
+// The construction is the textbook one: the pattern is parsed into a Glushkov
+// automaton (one NFA state per character class occurrence, so no epsilon
+// transitions) and then determinised with the subset construction. The reverse
+// automaton falls out for free by swapping the first/last sets and reversing
+// the follow relation.
+//
+// Supported syntax: literals, escapes (\w \W \d \D \s \S and escaped
+// punctuation), character classes with ranges and negation, (...) and (?:...)
+// groups, alternation and the * + ? quantifiers. That's all the identifier
+// definitions need.
+
+namespace ycmd
+{
+  // Every ASCII character is its own symbol. Everything else is folded into one
+  // of these categories, which is enough to give \w, \d and \s their Unicode
+  // meaning.
+  enum class UnicodeCategory : uint8_t
+  {
+    WORD,
+    DIGIT,
+    SPACE,
+    OTHER,
+  };
+
+  constexpr size_t NUM_ASCII_SYMBOLS = 128;
+  constexpr size_t NUM_SYMBOLS = NUM_ASCII_SYMBOLS + 4;
+
+  inline UnicodeCategory CategoryOf( char32_t code_point )
+  {
+    auto c = static_cast< UChar32 >( code_point );
+    auto mask = U_GET_GC_MASK( c );
+    if ( mask & U_GC_ND_MASK )
+    {
+      return UnicodeCategory::DIGIT;
+    }
+    if ( mask & ( U_GC_L_MASK | U_GC_M_MASK ) )
+    {
+      return UnicodeCategory::WORD;
+    }
+    if ( u_isUWhiteSpace( c ) )
+    {
+      return UnicodeCategory::SPACE;
+    }
+    return UnicodeCategory::OTHER;
+  }
+
+  inline size_t SymbolOf( char32_t code_point )
+  {
+    if ( code_point < NUM_ASCII_SYMBOLS )
+    {
+      return code_point;
+    }
+    return NUM_ASCII_SYMBOLS + static_cast< size_t >( CategoryOf( code_point ) );
+  }
+
+  // Returns the symbol for the code point starting at text[ pos ] and advances
+  // pos past it. Invalid UTF-8 is consumed a byte at a time and treated as
+  // OTHER.
+  inline size_t NextSymbol( std::string_view text, size_t& pos )
+  {
+    if ( IsAscii( text[ pos ] ) )
+    {
+      return static_cast< size_t >( text[ pos++ ] );
+    }
+
+    int32_t offset = 0;
+    int32_t length = static_cast< int32_t >(
+      std::min< size_t >( text.size() - pos, U8_MAX_LENGTH ) );
+    UChar32 c;
+    U8_NEXT( reinterpret_cast< const uint8_t* >( text.data() + pos ),
+             offset,
+             length,
+             c );
+    pos += offset;
+    if ( c < 0 )
+    {
+      return NUM_ASCII_SYMBOLS +
+        static_cast< size_t >( UnicodeCategory::OTHER );
+    }
+    return SymbolOf( static_cast< char32_t >( c ) );
+  }
+
+  inline size_t NextSymbol( std::u32string_view text, size_t& pos )
+  {
+    return SymbolOf( text[ pos++ ] );
+  }
+
+  namespace detail
+  {
+    constexpr size_t MAX_POSITIONS = 64;
+    constexpr size_t MAX_DFA_STATES = 32;
+    constexpr size_t MAX_SYMBOL_CLASSES = 32;
+
+    constexpr size_t UnicodeSymbol( UnicodeCategory category )
+    {
+      return NUM_ASCII_SYMBOLS + static_cast< size_t >( category );
+    }
+
+    struct SymbolSet
+    {
+      std::array< bool, NUM_SYMBOLS > members{};
+
+      constexpr void Add( size_t symbol ) { members[ symbol ] = true; }
+
+      constexpr void AddRange( char first, char last )
+      {
+        for ( auto c = first; c <= last; ++c )
+        {
+          Add( static_cast< size_t >( c ) );
+        }
+      }
+
+      constexpr void Add( const SymbolSet& other )
+      {
+        for ( size_t i = 0; i < NUM_SYMBOLS; ++i )
+        {
+          members[ i ] = members[ i ] || other.members[ i ];
+        }
+      }
+
+      constexpr SymbolSet Complement() const
+      {
+        SymbolSet result;
+        for ( size_t i = 0; i < NUM_SYMBOLS; ++i )
+        {
+          result.members[ i ] = !members[ i ];
+        }
+        return result;
+      }
+    };
+
+    constexpr SymbolSet WordSymbols()
+    {
+      SymbolSet s;
+      s.AddRange( 'a', 'z' );
+      s.AddRange( 'A', 'Z' );
+      s.AddRange( '0', '9' );
+      s.Add( '_' );
+      s.Add( UnicodeSymbol( UnicodeCategory::WORD ) );
+      s.Add( UnicodeSymbol( UnicodeCategory::DIGIT ) );
+      return s;
+    }
+
+    constexpr SymbolSet DigitSymbols()
+    {
+      SymbolSet s;
+      s.AddRange( '0', '9' );
+      s.Add( UnicodeSymbol( UnicodeCategory::DIGIT ) );
+      return s;
+    }
+
+    constexpr SymbolSet SpaceSymbols()
+    {
+      SymbolSet s;
+      for ( char c : std::string_view{ " \t\n\r\f\v" } )
+      {
+        s.Add( static_cast< size_t >( c ) );
+      }
+      s.Add( UnicodeSymbol( UnicodeCategory::SPACE ) );
+      return s;
+    }
+
+    template< typename F >
+    constexpr void ForEachBit( uint64_t bits, F&& f )
+    {
+      while ( bits )
+      {
+        f( static_cast< size_t >( std::countr_zero( bits ) ) );
+        bits &= bits - 1;
+      }
+    }
+
+    // A Glushkov automaton: the "positions" are the character class
+    // occurrences in the pattern.
+    struct Glushkov
+    {
+      size_t num_positions = 0;
+      std::array< SymbolSet, MAX_POSITIONS > position_symbols{};
+      std::array< uint64_t, MAX_POSITIONS > follow{};
+      uint64_t first = 0;
+      uint64_t last = 0;
+    };
+
+    class PatternParser
+    {
+    public:
+      constexpr explicit PatternParser( std::string_view pattern )
+        : pattern_( pattern )
+      {
+      }
+
+      constexpr Glushkov Parse()
+      {
+        Fragment f = Alternation();
+        if ( pos_ != pattern_.size() )
+        {
+          throw std::invalid_argument( "Unexpected character in pattern" );
+        }
+        if ( f.nullable )
+        {
+          throw std::invalid_argument( "Pattern matches the empty string" );
+        }
+        result_.first = f.first;
+        result_.last = f.last;
+        return result_;
+      }
+
+    private:
+      struct Fragment
+      {
+        bool nullable = true;
+        uint64_t first = 0;
+        uint64_t last = 0;
+      };
+
+      constexpr bool AtEnd() const { return pos_ == pattern_.size(); }
+      constexpr char Peek() const { return pattern_[ pos_ ]; }
+      constexpr char Next()
+      {
+        if ( AtEnd() )
+        {
+          throw std::invalid_argument( "Unexpected end of pattern" );
+        }
+        return pattern_[ pos_++ ];
+      }
+
+      constexpr void Connect( uint64_t from, uint64_t to )
+      {
+        ForEachBit( from, [ & ]( size_t p ) { result_.follow[ p ] |= to; } );
+      }
+
+      constexpr Fragment Alternation()
+      {
+        Fragment f = Sequence();
+        while ( !AtEnd() && Peek() == '|' )
+        {
+          ++pos_;
+          Fragment alt = Sequence();
+          f.nullable = f.nullable || alt.nullable;
+          f.first |= alt.first;
+          f.last |= alt.last;
+        }
+        return f;
+      }
+
+      constexpr Fragment Sequence()
+      {
+        Fragment f;
+        while ( !AtEnd() && Peek() != '|' && Peek() != ')' )
+        {
+          Fragment next = Repetition();
+          Connect( f.last, next.first );
+          f.first |= f.nullable ? next.first : 0;
+          f.last = next.last | ( next.nullable ? f.last : 0 );
+          f.nullable = f.nullable && next.nullable;
+        }
+        return f;
+      }
+
+      constexpr Fragment Repetition()
+      {
+        Fragment f = Atom();
+        while ( !AtEnd() && ( Peek() == '*' || Peek() == '+' || Peek() == '?' ) )
+        {
+          char q = Next();
+          if ( q != '?' )
+          {
+            Connect( f.last, f.first );
+          }
+          if ( q != '+' )
+          {
+            f.nullable = true;
+          }
+        }
+        return f;
+      }
+
+      constexpr Fragment Atom()
+      {
+        char c = Next();
+        switch ( c )
+        {
+          case '(':
+          {
+            if ( !AtEnd() && Peek() == '?' )
+            {
+              ++pos_;
+              if ( Next() != ':' )
+              {
+                throw std::invalid_argument( "Only (?:...) groups are supported" );
+              }
+            }
+            Fragment f = Alternation();
+            if ( Next() != ')' )
+            {
+              throw std::invalid_argument( "Unbalanced parentheses" );
+            }
+            return f;
+          }
+          case '[':
+            return Position( Class() );
+          case '\\':
+            return Position( Escape() );
+          case ')': case ']': case '|': case '*': case '+': case '?':
+          case '.': case '^': case '$': case '{': case '}':
+            throw std::invalid_argument( "Unsupported pattern syntax" );
+          default:
+          {
+            SymbolSet s;
+            s.Add( static_cast< size_t >( c ) );
+            return Position( s );
+          }
+        }
+      }
+
+      constexpr Fragment Position( const SymbolSet& symbols )
+      {
+        if ( result_.num_positions == MAX_POSITIONS )
+        {
+          throw std::length_error( "Pattern too long" );
+        }
+        size_t p = result_.num_positions++;
+        result_.position_symbols[ p ] = symbols;
+        uint64_t bit = uint64_t{ 1 } << p;
+        return { false, bit, bit };
+      }
+
+      constexpr SymbolSet Escape()
+      {
+        char c = Next();
+        switch ( c )
+        {
+          case 'w': return WordSymbols();
+          case 'W': return WordSymbols().Complement();
+          case 'd': return DigitSymbols();
+          case 'D': return DigitSymbols().Complement();
+          case 's': return SpaceSymbols();
+          case 'S': return SpaceSymbols().Complement();
+          default:
+          {
+            if ( ( c >= 'a' && c <= 'z' ) ||
+                 ( c >= 'A' && c <= 'Z' ) ||
+                 ( c >= '0' && c <= '9' ) )
+            {
+              throw std::invalid_argument( "Unsupported escape" );
+            }
+            SymbolSet s;
+            s.Add( static_cast< size_t >( c ) );
+            return s;
+          }
+        }
+      }
+
+      constexpr SymbolSet Class()
+      {
+        bool negated = !AtEnd() && Peek() == '^';
+        if ( negated )
+        {
+          ++pos_;
+        }
+
+        SymbolSet s;
+        bool first = true;
+        while ( first || Peek() != ']' )
+        {
+          first = false;
+          char c = Next();
+          if ( c == '\\' )
+          {
+            s.Add( Escape() );
+            continue;
+          }
+
+          if ( pos_ + 1 < pattern_.size() &&
+               Peek() == '-' &&
+               pattern_[ pos_ + 1 ] != ']' )
+          {
+            ++pos_;
+            char last = Next();
+            if ( last < c )
+            {
+              throw std::invalid_argument( "Invalid range" );
+            }
+            s.AddRange( c, last );
+          }
+          else
+          {
+            s.Add( static_cast< size_t >( c ) );
+          }
+        }
+        ++pos_;
+
+        return negated ? s.Complement() : s;
+      }
+
+      std::string_view pattern_;
+      size_t pos_ = 0;
+      Glushkov result_{};
+    };
+
+    // A DFA over symbol classes. State 0 is the dead state and state 1 the
+    // start state.
+    struct Dfa
+    {
+      static constexpr uint8_t DEAD = 0;
+      static constexpr uint8_t START = 1;
+
+      std::array< uint8_t, NUM_SYMBOLS > symbol_class{};
+      std::array< std::array< uint8_t, MAX_SYMBOL_CLASSES >, MAX_DFA_STATES >
+        transitions{};
+      std::array< bool, MAX_DFA_STATES > accepting{};
+
+      constexpr uint8_t Step( uint8_t state, size_t symbol ) const
+      {
+        return transitions[ state ][ symbol_class[ symbol ] ];
+      }
+    };
+
+    // Subset construction. |initial| is the set of positions which can consume
+    // the first symbol, |successors[p]| the set of positions which can follow
+    // position p, and a state is accepting if it contains any of |final|.
+    constexpr Dfa Determinise( const Glushkov& g,
+                               uint64_t initial,
+                               const std::array< uint64_t, MAX_POSITIONS >&
+                                 successors,
+                               uint64_t final )
+    {
+      Dfa dfa;
+
+      // Symbols which can be consumed by the same set of positions are
+      // indistinguishable, so the transition tables are indexed by symbol class
+      // rather than by symbol. Class 0 is the set of symbols that can't appear
+      // anywhere in the pattern.
+      std::array< uint64_t, MAX_SYMBOL_CLASSES > class_positions{};
+      size_t num_classes = 1;
+      for ( size_t symbol = 0; symbol < NUM_SYMBOLS; ++symbol )
+      {
+        uint64_t positions = 0;
+        for ( size_t p = 0; p < g.num_positions; ++p )
+        {
+          if ( g.position_symbols[ p ].members[ symbol ] )
+          {
+            positions |= uint64_t{ 1 } << p;
+          }
+        }
+
+        size_t cls = 0;
+        if ( positions )
+        {
+          cls = 1;
+          while ( cls < num_classes && class_positions[ cls ] != positions )
+          {
+            ++cls;
+          }
+          if ( cls == num_classes )
+          {
+            if ( num_classes == MAX_SYMBOL_CLASSES )
+            {
+              throw std::length_error( "Too many symbol classes" );
+            }
+            class_positions[ num_classes++ ] = positions;
+          }
+        }
+        dfa.symbol_class[ symbol ] = static_cast< uint8_t >( cls );
+      }
+
+      // States other than DEAD and START are identified by their position set.
+      std::array< uint64_t, MAX_DFA_STATES > state_positions{};
+      size_t num_states = 2;
+      for ( size_t state = Dfa::START; state < num_states; ++state )
+      {
+        uint64_t reachable = initial;
+        if ( state != Dfa::START )
+        {
+          reachable = 0;
+          ForEachBit( state_positions[ state ], [ & ]( size_t p ) {
+            reachable |= successors[ p ];
+          } );
+        }
+
+        for ( size_t cls = 1; cls < num_classes; ++cls )
+        {
+          uint64_t next = reachable & class_positions[ cls ];
+          if ( !next )
+          {
+            continue;
+          }
+
+          size_t target = 2;
+          while ( target < num_states && state_positions[ target ] != next )
+          {
+            ++target;
+          }
+          if ( target == num_states )
+          {
+            if ( num_states == MAX_DFA_STATES )
+            {
+              throw std::length_error( "Too many DFA states" );
+            }
+            state_positions[ num_states ] = next;
+            dfa.accepting[ num_states ] = ( next & final ) != 0;
+            ++num_states;
+          }
+          dfa.transitions[ state ][ cls ] = static_cast< uint8_t >( target );
+        }
+      }
+
+      return dfa;
+    }
+  }
+
+  struct IdentifierLexer
+  {
+    // Matches identifiers left to right.
+    detail::Dfa forward;
+    // Matches reversed identifiers, i.e. runs from the end of an identifier
+    // towards its start.
+    detail::Dfa reverse;
+    // ASCII characters which can start an identifier. This lets the lexer skip
+    // over punctuation and whitespace without touching the DFA.
+    std::array< bool, NUM_ASCII_SYMBOLS > ascii_start{};
+    // ASCII characters which can appear anywhere in an identifier. Identifiers
+    // can only occur within runs of these (and non-ASCII) bytes.
+    AsciiByteSet identifier_bytes{};
+
+    // Returns the length (in code units) of the longest prefix of
+    // text[ start: ] which is an identifier, or 0 if there is none.
+    template< typename CharType >
+    size_t LongestIdentifierAt( std::basic_string_view< CharType > text,
+                                size_t start ) const
+    {
+      size_t longest = 0;
+      uint8_t state = detail::Dfa::START;
+      size_t pos = start;
+      while ( pos < text.size() )
+      {
+        state = forward.Step( state, NextSymbol( text, pos ) );
+        if ( state == detail::Dfa::DEAD )
+        {
+          break;
+        }
+        if ( forward.accepting[ state ] )
+        {
+          longest = pos - start;
+        }
+      }
+      return longest;
+    }
+
+    // Returns the next identifier in text at or after pos, and advances pos
+    // past it. Returns an empty view (with pos == text.size()) when there are
+    // no more. Identifiers are found like a regex search would: leftmost first,
+    // then longest.
+    template< typename CharType >
+    std::basic_string_view< CharType > NextIdentifier(
+      std::basic_string_view< CharType > text,
+      size_t& pos ) const
+    {
+      while ( pos < text.size() )
+      {
+        auto c = text[ pos ];
+        if ( IsAscii( c ) && !ascii_start[ static_cast< size_t >( c ) ] )
+        {
+          ++pos;
+          continue;
+        }
+
+        if ( auto length = LongestIdentifierAt( text, pos ); length > 0 )
+        {
+          pos += length;
+          return text.substr( pos - length, length );
+        }
+        NextSymbol( text, pos );
+      }
+      return {};
+    }
+
+    // Calls f( identifier ) for each identifier in text, in order, as
+    // NextIdentifier would find them. This is much faster for large inputs, as
+    // the text is first split (64 bytes at a time) into runs of bytes which can
+    // be part of an identifier, and only those runs are lexed.
+    template< typename F >
+    void ForEachIdentifier( std::string_view text, F&& f ) const
+    {
+      auto lex_run = [ & ]( size_t start, size_t end ) {
+        auto run = text.substr( start, end - start );
+        size_t pos = 0;
+        for ( auto identifier = NextIdentifier( run, pos );
+              !identifier.empty();
+              identifier = NextIdentifier( run, pos ) )
+        {
+          f( identifier );
+        }
+      };
+
+      bool in_run = false;
+      size_t run_start = 0;
+      for ( size_t block = 0; block < text.size(); block += 64 )
+      {
+        uint64_t mask = ClassifyBlock( text.substr( block ), identifier_bytes );
+        size_t offset = 0;
+        while ( offset < 64 )
+        {
+          // Find the next run boundary: the next set bit when looking for the
+          // start of a run, the next clear bit when looking for its end.
+          uint64_t bits = ( in_run ? ~mask : mask ) & ( ~uint64_t{ 0 } << offset );
+          if ( !bits )
+          {
+            break;
+          }
+          offset = static_cast< size_t >( std::countr_zero( bits ) );
+          if ( in_run )
+          {
+            lex_run( run_start, std::min( block + offset, text.size() ) );
+          }
+          else
+          {
+            run_start = block + offset;
+          }
+          in_run = !in_run;
+        }
+      }
+
+      if ( in_run )
+      {
+        lex_run( run_start, text.size() );
+      }
+    }
+
+    template< typename CharType >
+    bool IsIdentifier( std::basic_string_view< CharType > text ) const
+    {
+      return !text.empty() && LongestIdentifierAt( text, 0 ) == text.size();
+    }
+
+    // Returns the length (in code points) of the longest suffix of |text| which
+    // is an identifier, or 0 if there is none.
+    template< typename CharType >
+    size_t LongestIdentifierSuffix( std::basic_string_view< CharType > text ) const
+    {
+      size_t longest = 0;
+      uint8_t state = detail::Dfa::START;
+      for ( size_t length = 1; length <= text.size(); ++length )
+      {
+        state = reverse.Step( state, SymbolOf( text[ text.size() - length ] ) );
+        if ( state == detail::Dfa::DEAD )
+        {
+          break;
+        }
+        if ( reverse.accepting[ state ] )
+        {
+          longest = length;
+        }
+      }
+      return longest;
+    }
+  };
+
+  constexpr IdentifierLexer CompileIdentifierLexer( std::string_view pattern )
+  {
+    detail::Glushkov g = detail::PatternParser( pattern ).Parse();
+
+    std::array< uint64_t, detail::MAX_POSITIONS > predecessors{};
+    for ( size_t p = 0; p < g.num_positions; ++p )
+    {
+      detail::ForEachBit( g.follow[ p ], [ & ]( size_t q ) {
+        predecessors[ q ] |= uint64_t{ 1 } << p;
+      } );
+    }
+
+    IdentifierLexer lexer{
+      .forward = detail::Determinise( g, g.first, g.follow, g.last ),
+      .reverse = detail::Determinise( g, g.last, predecessors, g.first ),
+    };
+    for ( size_t c = 0; c < NUM_ASCII_SYMBOLS; ++c )
+    {
+      lexer.ascii_start[ c ] =
+        lexer.forward.Step( detail::Dfa::START, c ) != detail::Dfa::DEAD;
+      if ( lexer.forward.symbol_class[ c ] != 0 )
+      {
+        lexer.identifier_bytes.Add( static_cast< uint8_t >( c ) );
+      }
+    }
+    return lexer;
+  }
+}
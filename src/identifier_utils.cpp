@@ -13,9 +13,11 @@
 #include <boost/regex/v5/regex_match.hpp>
 #include <boost/regex/v5/regex_search.hpp>
 
+#include <absl/container/flat_hash_set.h>
 #include <c++/v1/concepts>
 #include <functional>
 #include <iterator>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -23,11 +25,10 @@
 #include "ycmd.hpp"
 #include "api.hpp"
 #include "ztd/text.hpp"
+#include "comment_and_string_lexer.cpp"
+#include "identifier_lexer.cpp"
 
 namespace ycmd {
-  const boost::u32regex DEFAULT_IDENTIFIER_REGEX =
-    boost::make_u32regex( R"([^\W\d]\w*)" );
-
   namespace detail {
     // this ugly boilerplate is required to make heterogenous lookup work for
     // unordered containers
@@ -45,75 +46,241 @@ namespace ycmd {
       }
     };
 
-    using svmatch = boost::match_results<std::string_view::const_iterator>;
-
-    using u32svregex_iterator =
-      boost::u32regex_iterator<std::string_view::const_iterator>;
     using u32svregex_token_iterator =
       boost::u32regex_token_iterator<std::string_view::const_iterator>;
+  }
 
-    using u32sregex_iterator =
-      boost::u32regex_iterator<std::string::const_iterator>;
-    using u32sregex_token_iterator =
-      boost::u32regex_token_iterator<std::string::const_iterator>;
+  // These are ported from identifier_utils.py. Patterns there which use
+  // lookahead are rewritten to equivalent ones without it, as the lexer
+  // compiler doesn't support it. Note that the lexers always find the longest
+  // match, whereas python's re takes the first alternative which matches.
+
+  constexpr IdentifierLexer DEFAULT_IDENTIFIER_LEXER =
+    CompileIdentifierLexer( R"([^\W\d]\w*)" );
+
+  namespace lexers {
+    // Spec:
+    // http://www.w3.org/TR/CSS2/syndata.html#characters
+    // Good summary:
+    // http://stackoverflow.com/a/449000/1672783
+    constexpr IdentifierLexer CSS =
+      CompileIdentifierLexer( R"(-?[^\W\d][\w-]*)" );
+
+    // Spec: http://www.w3.org/TR/html5/syntax.html#tag-name-state
+    // But not quite since not everything we want to pull out is a tag name. We
+    // also want attribute names (and probably unquoted attribute values).
+    // And we also want to ignore common template chars like `}` and `{`.
+    constexpr IdentifierLexer HTML =
+      CompileIdentifierLexer( R"([a-zA-Z][^\s/>='\"}{\.]*)" );
+
+    // Spec: http://cran.r-project.org/doc/manuals/r-release/R-lang.pdf
+    // Section 10.3.2.
+    // Can be any sequence of '.', '_' and alphanum BUT can't start with:
+    //   - '.' followed by digit
+    //   - digit
+    //   - '_'
+    constexpr IdentifierLexer R =
+      CompileIdentifierLexer(
+        R"([^\W\d_][\.\w]*|\.(?:[^\W\d][\.\w]*|\.[\.\w]*)?)" );
+
+    // Spec: http://clojure.org/reader
+    // Section: Symbols
+    constexpr IdentifierLexer CLOJURE =
+      CompileIdentifierLexer(
+        R"([-\*\+!_\?:\.a-zA-Z][-\*\+!_\?:\.\w]*/?[-\*\+!_\?:\.\w]*)" );
+
+    // Spec: http://www.haskell.org/onlinereport/lexemes.html
+    // Section 2.4
+    constexpr IdentifierLexer HASKELL =
+      CompileIdentifierLexer( R"([_a-zA-Z][\w']+)" );
+
+    // Spec: ?
+    // Colons are often used in labels (e.g. \label{fig:foobar}) so we accept
+    // them in the middle of an identifier but not at its extremities. We also
+    // accept dashes for compound words.
+    constexpr IdentifierLexer TEX =
+      CompileIdentifierLexer( R"([^\W\d](?:[\w:-]*\w)?)" );
+
+    // Spec: http://doc.perl6.org/language/syntax
+    constexpr IdentifierLexer PERL6 =
+      CompileIdentifierLexer( R"([_a-zA-Z](?:\w|[-'][_a-zA-Z])*)" );
+
+    // https://www.scheme.com/tspl4/grammar.html#grammar:symbols
+    constexpr IdentifierLexer SCHEME =
+      CompileIdentifierLexer(
+        R"(\+|\-|\.\.\.|)"
+        R"((?:->|\\x[0-9A-Fa-f]+;|[!$%&*/:<=>?~^]|[^\W\d]))"
+        R"((?:\\x[0-9A-Fa-f]+;|[-+.@!$%&*/:<=>?~^\w])*)" );
   }
 
   const std::unordered_map< std::string,
-                            boost::u32regex,
+                            const IdentifierLexer*,
                             detail::string_hash,
-                            std::equal_to<> > FILETYPE_TO_IDENTIFIER_REGEX {
-    // TODO: There's a lot to port here from identifier_utils.py
+                            std::equal_to<> > FILETYPE_TO_IDENTIFIER_LEXER {
+    { "css", &lexers::CSS },
+    { "scss", &lexers::CSS },
+    { "sass", &lexers::CSS },
+    { "less", &lexers::CSS },
+    { "html", &lexers::HTML },
+    { "r", &lexers::R },
+    { "clojure", &lexers::CLOJURE },
+    { "elisp", &lexers::CLOJURE },
+    { "lisp", &lexers::CLOJURE },
+    { "haskell", &lexers::HASKELL },
+    { "tex", &lexers::TEX },
+    { "perl6", &lexers::PERL6 },
+    { "raku", &lexers::PERL6 },
+    { "scheme", &lexers::SCHEME },
   };
 
-  const boost::u32regex& IdentifierRegexForFiletype( std::string_view filetype ) {
-    if ( auto pos = FILETYPE_TO_IDENTIFIER_REGEX.find( filetype );
-         pos != FILETYPE_TO_IDENTIFIER_REGEX.end() ) {
-      return pos->second;
+  const IdentifierLexer& IdentifierLexerForFiletype( std::string_view filetype ) {
+    if ( auto pos = FILETYPE_TO_IDENTIFIER_LEXER.find( filetype );
+         pos != FILETYPE_TO_IDENTIFIER_LEXER.end() ) {
+      return *pos->second;
     }
 
-    return DEFAULT_IDENTIFIER_REGEX;
+    return DEFAULT_IDENTIFIER_LEXER;
   }
 
-  std::vector<std::string> IdentifiersFromBuffer(
-    const api::SimpleRequest::FileData& file )
-  {
-    auto identifier_regex = IdentifierRegexForFiletype( file.filetypes[ 0 ] );
+  namespace lexers {
+    constexpr CommentAndStringLexer DEFAULT_COMMENT_AND_STRING {
+      {
+        .c_comments = true,
+        .cpp_comments = true,
+        .hash_comments = true,
+        .triple_quotes = true,
+        .single_quotes = true,
+        .double_quotes = true,
+      }
+    };
 
-    detail::u32sregex_iterator b( file.contents.begin(),
-                                  file.contents.end(),
-                                  identifier_regex );
-    detail::u32sregex_iterator e;
+    // Spec:
+    // http://www.ecma-international.org/ecma-262/6.0/#sec-comments
+    // http://www.ecma-international.org/ecma-262/6.0/#sec-literals-string-literals
+    constexpr CommentAndStringLexer JAVASCRIPT_COMMENT_AND_STRING {
+      {
+        .c_comments = true,
+        .cpp_comments = true,
+        .single_quotes = true,
+        .double_quotes = true,
+      }
+    };
 
-    // FIXME: sigh... more sad copying
-    std::vector<std::string> candidates;
-    candidates.reserve( std::distance( b, e ) );
-    std::for_each( b, e, [&]( const auto& match ) {
-      candidates.push_back( match.str() );
-    } );
+    // Spec:
+    // https://golang.org/ref/spec#Comments
+    // https://golang.org/ref/spec#String_literals
+    // https://golang.org/ref/spec#Rune_literals
+    constexpr CommentAndStringLexer GO_COMMENT_AND_STRING {
+      {
+        .c_comments = true,
+        .cpp_comments = true,
+        .single_quotes = true,
+        .double_quotes = true,
+        .back_quotes = true,
+      }
+    };
 
-    return candidates;
+    // Spec:
+    // https://docs.python.org/3.6/reference/lexical_analysis.html#comments
+    // https://docs.python.org/3.6/reference/lexical_analysis.html#literals
+    constexpr CommentAndStringLexer PYTHON_COMMENT_AND_STRING {
+      {
+        .hash_comments = true,
+        .triple_quotes = true,
+        .single_quotes = true,
+        .double_quotes = true,
+      }
+    };
+
+    // Spec:
+    // https://doc.rust-lang.org/reference.html#comments
+    // https://doc.rust-lang.org/reference.html#character-and-string-literals
+    constexpr CommentAndStringLexer RUST_COMMENT_AND_STRING {
+      {
+        .cpp_comments = true,
+        .single_quotes = true,
+        .double_quotes = true,
+      }
+    };
   }
 
-#if 0
   const std::unordered_map< std::string,
-                      boost::regex,
-                      detail::string_hash,
-                      std::equal_to<> > FILETYPE_TO_COMMENT_AND_STRING_REGEX {
-
-    // TODO: There's a lot to port here from identifier_utils.py
+                            const CommentAndStringLexer*,
+                            detail::string_hash,
+                            std::equal_to<> >
+    FILETYPE_TO_COMMENT_AND_STRING_LEXER {
+    { "javascript", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "c", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "cpp", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "cuda", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "objc", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "objcpp", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "javascriptreact", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "typescript", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "typescriptreact", &lexers::JAVASCRIPT_COMMENT_AND_STRING },
+    { "go", &lexers::GO_COMMENT_AND_STRING },
+    { "python", &lexers::PYTHON_COMMENT_AND_STRING },
+    { "rust", &lexers::RUST_COMMENT_AND_STRING },
   };
 
-  std::string StripCommentsIfRequired(
-    const api::SimpleRequest::FileData& file )
+  const CommentAndStringLexer& CommentAndStringLexerForFiletype(
+    std::string_view filetype ) {
+    if ( auto pos = FILETYPE_TO_COMMENT_AND_STRING_LEXER.find( filetype );
+         pos != FILETYPE_TO_COMMENT_AND_STRING_LEXER.end() ) {
+      return *pos->second;
+    }
+
+    return lexers::DEFAULT_COMMENT_AND_STRING;
+  }
+
+  // Calls f( code ) for each part of text which identifiers should be collected
+  // from. That's all of it if collect_from_comments_and_strings is set (the
+  // collect_identifiers_from_comments_and_strings option), otherwise just the
+  // parts outside comments and strings.
+  template< typename F >
+  void ForEachIdentifierSource( std::string_view text,
+                                std::string_view filetype,
+                                bool collect_from_comments_and_strings,
+                                F&& f )
   {
-    if ( !server.user_options[
-          "collect_identifiers_from_comments_and_strings" ] )
+    if ( collect_from_comments_and_strings )
     {
-      assert( false && "Not implemented yet" );
+      f( text );
+      return;
     }
-    return file.contents;
+
+    CommentAndStringLexerForFiletype( filetype ).ForEachCodeSpan(
+      text,
+      CommentAndStringLexer::State::CODE,
+      std::forward< F >( f ) );
+  }
+
+  // Returns the distinct identifiers in the file, in order of first appearance.
+  // The views are into file.contents.
+  std::vector<std::string_view> IdentifiersFromBuffer(
+    const api::SimpleRequest::FileData& file,
+    bool collect_from_comments_and_strings )
+  {
+    const auto& filetype = file.filetypes[ 0 ];
+    const auto& lexer = IdentifierLexerForFiletype( filetype );
+
+    std::vector<std::string_view> candidates;
+    absl::flat_hash_set<std::string_view> seen;
+    auto add = [&]( std::string_view identifier ) {
+      if ( seen.insert( identifier ).second )
+      {
+        candidates.push_back( identifier );
+      }
+    };
+    ForEachIdentifierSource( file.contents,
+                             filetype,
+                             collect_from_comments_and_strings,
+                             [&]( std::string_view code ) {
+                               lexer.ForEachIdentifier( code, add );
+                             } );
+
+    return candidates;
   }
-#endif
 
   boost::u32regex SPLIT_LINES = boost::make_u32regex( "\n" );
 
@@ -136,119 +303,66 @@ namespace ycmd {
       return file_lines;
   }
 
-  // TODO/FIXME: THe following should work on RequestWrap, but currently there's
-  // a circular include dependency (as request_wrap.cpp includes this file)
-  // split out a request_wrap header. or maybe convert the whole project to
-  // modules, just for fun/learning.
-
-  std::string IdentifierUnderCursor( const api::SimpleRequest& request_data )
+  // An identifier on a line. column is the 0-based byte offset of its start.
+  struct IdentifierSpan
   {
-    const auto& file = request_data.file_data.at( request_data.filepath );
-    // auto contents = StripCommentsIfRequired( file );
-    const auto& lines = SplitLines( file.contents );
-    const auto& line = lines[ request_data.line_num - 1 ];
-    size_t index = request_data.column_num - 1;
-
-    if ( index > line.length() )
-    {
-      return "";
-    }
+    size_t column;
+    std::string_view text;
 
-    auto identifier_regex = IdentifierRegexForFiletype( file.filetypes[ 0 ] );
-    detail::u32svregex_iterator b( line.begin(), line.end(), identifier_regex );
-    detail::u32svregex_iterator e;
+    size_t end() const { return column + text.size(); }
+  };
 
-    for( auto it = b; it != e; ++it )
+  // The identifiers must be in the order they appear on the line. index is the
+  // 0-based byte offset of the cursor.
+  std::string_view IdentifierUnderCursor(
+    std::span<const IdentifierSpan> identifiers,
+    size_t index )
+  {
+    for ( const auto& identifier : identifiers )
     {
-      const auto& match = *it;
-      size_t end = match.position() + match.length();
-      if ( end > index )
+      if ( identifier.end() > index )
       {
-        return match.str();
+        return identifier.text;
       }
     }
-
     return "";
   }
 
-  std::string IdentifierBeforeCursor( const api::SimpleRequest& request_data )
+  std::string_view IdentifierBeforeCursor(
+    std::span<const IdentifierSpan> identifiers,
+    size_t index )
   {
-    const auto& file = request_data.file_data.at( request_data.filepath );
-    // auto contents = StripCommentsIfRequired( file );
-    const auto& lines = SplitLines( file.contents );
-    const auto& line = lines[ request_data.line_num - 1 ];
-
-    size_t index = request_data.column_num - 1;
-
-    if ( index > line.length() )
+    std::string_view best;
+    for ( const auto& identifier : identifiers )
     {
-      return "";
-    }
-
-    // TODO: The real code in ycmd handles where the identifier is on the
-    // previous line
-    auto identifier_regex = IdentifierRegexForFiletype( file.filetypes[ 0 ] );
-    detail::u32svregex_iterator b( line.begin(), line.end(), identifier_regex );
-    detail::u32svregex_iterator e;
-
-    auto best = e;
-    for( auto it = b; it != e; ++it )
-    {
-      const auto& match = *it;
-      size_t end = match.position() + match.length();
-      if ( end <= index )
-      {
-        best = it;
-      }
-      else
+      if ( identifier.end() > index )
       {
         break;
       }
+      best = identifier.text;
     }
-    if ( best != e )
-    {
-      return best->str();
-    }
-    return "";
+    return best;
   }
 
   template< typename CharType >
-  bool IsIdentifier( const boost::u32regex& identifier_regex,
+  bool IsIdentifier( const IdentifierLexer& lexer,
                      std::basic_string_view<CharType> str ) {
-    return boost::u32regex_match( str.begin(), str.end(), identifier_regex );
+    return lexer.IsIdentifier( str );
   }
 
   size_t StartOfLongestIdentifierEndingAt(
     size_t column_codepoint,
-    const boost::u32regex& identifier_regex,
+    const IdentifierLexer& lexer,
     std::u32string_view line_value )
   {
-    auto end = column_codepoint - 1; // 0-based index into line_value()
-                                       // but points 1-past-the-end
-
-    if ( end <= 0 )
-      return 1; // we return a 1-based offset into line_value()
-
-    // We are working here in u32 space. Therefore it's safe to use simple
-    // integer offsetting, as we're working in codepoints.
-    for ( size_t start = end - 1; ; --start )
-    {
-      if ( !IsIdentifier( identifier_regex,
-                          std::u32string_view{
-                            line_value.data() + start,
-                            end - start
-                          } ) ) {
-        return start + 2; // this is the first non-identifier character. we
-                          // start at the next character + 1 for returning
-                          // 1-based value
-      }
-
-      if ( start == 0 )
-      {
-        return 1;
-      }
-    }
-    // impossible codepath
-    abort();
+    // column_codepoint is 1-based, so this is the 0-based index one past the
+    // end of the identifier. We are working here in u32 space, so it's safe to
+    // use simple integer offsetting.
+    auto end = std::min( column_codepoint - 1, line_value.size() );
+
+    // Returns a 1-based offset into line_value. If there's no identifier ending
+    // at the column, that's the column itself.
+    return column_codepoint -
+      lexer.LongestIdentifierSuffix( line_value.substr( 0, end ) );
   }
 }
@@ -73,8 +73,7 @@ namespace ycmd
     Lazy<size_t> start_column{ [this]() -> size_t {
       // use the unicode-safe calculation, then convert to bytes
       // the key pointis that we can do simple integer math on u32string/_view,
-      // which is required by the faffy StartOfLongestIdentifierEndingAt
-      // calculation
+      // which is what StartOfLongestIdentifierEndingAt works on
       std::u32string_view unicode_prefix = {
         line_value().data(),
         start_codepoint()
@@ -84,11 +83,10 @@ namespace ycmd
     } };
 
     Lazy<size_t> start_codepoint{ [this]() -> size_t {
-      const auto& identifier_regex = IdentifierRegexForFiletype(
-        first_filetype() );
-      return StartOfLongestIdentifierEndingAt( column_codepoint(),
-                                               identifier_regex,
-                                               line_value() );
+      return StartOfLongestIdentifierEndingAt(
+        column_codepoint(),
+        IdentifierLexerForFiletype( first_filetype() ),
+        line_value() );
     } };
 
     Lazy<size_t> column_codepoint{ [this]() {
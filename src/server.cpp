@@ -6,8 +6,13 @@
 #include "completers/general/filename_completer.cpp"
 #include "completers/general/ultisnips_completer.cpp"
 #include "completers/cpp/clangd_completer.cpp"
+#include "core/Candidate.h"
+#include "core/Repository.h"
+#include "worker_pool.cpp"
+#include <algorithm>
 #include <boost/asio/io_context.hpp>
 #include <exception>
+#include <limits>
 #include <optional>
 #include <stdexcept>
 
@@ -15,6 +20,7 @@ namespace ycmd::server
 {
   struct server {
     asio::io_context ctx;
+    WorkerPool workers{ default_worker_count() };
     json user_options;
 
     enum class SemanticCompleterKind
@@ -41,7 +47,9 @@ namespace ycmd::server
       return SemanticCompleterKind::NONE;
     }
 
-    completers::general::IdentifierCompleter identifier_completer{user_options};
+    completers::general::IdentifierCompleter identifier_completer{
+      user_options,
+      workers };
     completers::general::FilenameCompleter filename_completer;
     completers::general::UltiSnipsCompleter ultisnips_completer;
     std::optional<completers::cpp::ClangdCompleter> clangd_completer;
@@ -55,9 +63,56 @@ namespace ycmd::server
     void initialize( json user_options )
     {
       this->user_options = std::move( user_options );
+
+      size_t budget_mb = DEFAULT_MAX_CANDIDATE_MEMORY_MB;
+      auto setting = this->user_options.find( "max_candidate_memory_mb" );
+      if ( setting != this->user_options.end() )
+      {
+        if ( setting->is_number_unsigned() )
+        {
+          budget_mb = setting->get<size_t>();
+        }
+        else
+        {
+          LOG(warning) << "Ignoring max_candidate_memory_mb " << *setting
+                       << ", which isn't a number of megabytes";
+        }
+      }
+
+      // Budgets too big to count in bytes are as good as no budget.
+      budget_mb = std::min( budget_mb, MAX_CANDIDATE_MEMORY_MB );
+      YouCompleteMe::Repository<YouCompleteMe::Candidate>::Instance()
+        .SetMemoryBudget( budget_mb << 20 );
+    }
+
+    // Throws away candidates which nothing is holding on to, if they are
+    // taking up more than the budget (e.g. after filtering a lot of file
+    // names). Requests don't hold on to borrowed candidates across a co_await,
+    // so this is safe at the end of a request, on the I/O thread, unless
+    // identifiers are being harvested on the workers; then it's left to a
+    // later request.
+    void trim_candidates()
+    {
+      if ( identifier_completer.harvests_in_progress > 0 )
+      {
+        return;
+      }
+
+      auto& candidates =
+        YouCompleteMe::Repository<YouCompleteMe::Candidate>::Instance();
+      if ( auto num_trimmed = candidates.Trim() )
+      {
+        LOG(debug) << "Trimmed " << num_trimmed << " candidates, leaving "
+                   << candidates.NumStoredElements() << " ("
+                   << candidates.MemoryUsage() << " bytes)";
+      }
     }
 
   private:
+    static constexpr size_t DEFAULT_MAX_CANDIDATE_MEMORY_MB = 256;
+    static constexpr size_t MAX_CANDIDATE_MEMORY_MB =
+      std::numeric_limits<size_t>::max() >> 20;
+
     server() = default;
     server( const server& ) = delete;
     server( server&& ) = delete;
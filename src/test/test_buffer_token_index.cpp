@@ -0,0 +1,236 @@
+#include "../buffer_token_index.cpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace ycmd;
+
+namespace
+{
+  using Strings = std::vector<std::string>;
+
+  // Sorted, as the order of identifiers in the index is unspecified
+  template< typename Container >
+  Strings Sorted( const Container& c )
+  {
+    Strings result( c.begin(), c.end() );
+    std::sort( result.begin(), result.end() );
+    return result;
+  }
+
+  Strings LineIdentifiers( const BufferTokenIndex& index,
+                                            size_t line_num )
+  {
+    Strings identifiers;
+    for ( const auto& identifier : index.LineIdentifiers( line_num ) )
+    {
+      identifiers.emplace_back( identifier.text );
+    }
+    return identifiers;
+  }
+
+  api::SimpleRequest MakeRequest( std::string_view filepath,
+                                  std::string_view filetype,
+                                  std::string_view contents,
+                                  int line_num,
+                                  int column_num )
+  {
+    api::SimpleRequest request;
+    request.line_num = line_num;
+    request.column_num = column_num;
+    request.filepath = filepath;
+    request.file_data[ request.filepath ] = {
+      .filetypes{ std::string( filetype ) },
+      .contents{ std::string( contents ) }
+    };
+    return request;
+  }
+}
+
+TEST( BufferTokenIndexTest, InitialUpdateAddsEverything )
+{
+  BufferTokenIndex index( IdentifierLexerForFiletype( "foo" ) );
+  auto diff = index.Update( "foo bar\nbaz foo\n\nqux" );
+
+  EXPECT_EQ( Sorted( diff.added ),
+             ( Strings{ "bar", "baz", "foo", "qux" } ) );
+  EXPECT_TRUE( diff.removed.empty() );
+  EXPECT_EQ( Sorted( index.Identifiers() ),
+             ( Strings{ "bar", "baz", "foo", "qux" } ) );
+
+  EXPECT_EQ( index.NumLines(), 4 );
+  EXPECT_EQ( LineIdentifiers( index, 1 ), ( Strings{ "foo", "bar" } ) );
+  EXPECT_EQ( LineIdentifiers( index, 3 ), Strings{} );
+  EXPECT_EQ( LineIdentifiers( index, 5 ), Strings{} );
+  EXPECT_EQ( index.LineIdentifiers( 2 )[ 1 ].column, 4 );
+}
+
+TEST( BufferTokenIndexTest, UpdateReportsOnlyChanges )
+{
+  BufferTokenIndex index( IdentifierLexerForFiletype( "foo" ) );
+  index.Update( "foo bar\nbaz foo\nqux" );
+
+  // Nothing changed
+  auto diff = index.Update( "foo bar\nbaz foo\nqux" );
+  EXPECT_TRUE( diff.added.empty() );
+  EXPECT_TRUE( diff.removed.empty() );
+
+  // One identifier renamed; foo is still on line 1
+  diff = index.Update( "foo bar\nbazinga foo\nqux" );
+  EXPECT_EQ( Sorted( diff.added ), ( Strings{ "bazinga" } ) );
+  EXPECT_EQ( Sorted( diff.removed ), ( Strings{ "baz" } ) );
+
+  // Identifier moved between lines which both changed
+  diff = index.Update( "foo\nbazinga foo bar\nqux" );
+  EXPECT_TRUE( diff.added.empty() );
+  EXPECT_TRUE( diff.removed.empty() );
+  EXPECT_EQ( LineIdentifiers( index, 2 ),
+             ( Strings{ "bazinga", "foo", "bar" } ) );
+
+  // Lines inserted and deleted
+  diff = index.Update( "new\nlines\nfoo\nqux" );
+  EXPECT_EQ( Sorted( diff.added ), ( Strings{ "lines", "new" } ) );
+  EXPECT_EQ( Sorted( diff.removed ), ( Strings{ "bar", "bazinga" } ) );
+  EXPECT_EQ( index.NumLines(), 4 );
+  EXPECT_EQ( LineIdentifiers( index, 4 ), Strings{ "qux" } );
+
+  diff = index.Update( "" );
+  EXPECT_TRUE( diff.added.empty() );
+  EXPECT_EQ( Sorted( diff.removed ),
+             ( Strings{ "foo", "lines", "new", "qux" } ) );
+  EXPECT_TRUE( index.Identifiers().empty() );
+  EXPECT_EQ( index.NumLines(), 1 );
+}
+
+TEST( BufferTokenIndexTest, MatchesFullRebuild )
+{
+  // Apply a series of edits to a large buffer, and check that the index always
+  // has the same identifiers as one built from scratch.
+  Strings lines;
+  for ( size_t i = 0; i < 500; ++i )
+  {
+    lines.push_back( "line" + std::to_string( i % 37 ) + " = shared;" );
+  }
+
+  auto join = [ & ]() {
+    std::string contents;
+    for ( const auto& line : lines )
+    {
+      contents.append( line ).append( "\n" );
+    }
+    return contents;
+  };
+
+  BufferTokenIndex index( IdentifierLexerForFiletype( "foo" ) );
+  index.Update( join() );
+
+  for ( size_t edit = 0; edit < 200; ++edit )
+  {
+    size_t line = ( edit * 7919 ) % lines.size();
+    switch ( edit % 3 )
+    {
+      case 0:
+        lines[ line ] = "edited" + std::to_string( edit ) + " shared";
+        break;
+      case 1:
+        lines.insert( lines.begin() + line, "inserted" + std::to_string( edit ) );
+        break;
+      case 2:
+        lines.erase( lines.begin() + line );
+        break;
+    }
+
+    auto contents = join();
+    index.Update( contents );
+
+    BufferTokenIndex rebuilt( IdentifierLexerForFiletype( "foo" ) );
+    rebuilt.Update( contents );
+    ASSERT_EQ( Sorted( index.Identifiers() ), Sorted( rebuilt.Identifiers() ) )
+      << edit;
+    ASSERT_EQ( index.NumLines(), rebuilt.NumLines() );
+    ASSERT_EQ( LineIdentifiers( index, line + 1 ),
+               LineIdentifiers( rebuilt, line + 1 ) );
+  }
+}
+
+TEST( BufferTokenIndexTest, CommentsAndStrings )
+{
+  BufferTokenIndex index( IdentifierLexerForFiletype( "cpp" ),
+                          &CommentAndStringLexerForFiletype( "cpp" ) );
+  auto diff = index.Update( "foo // bar\nbaz \"zoo\"\nqux" );
+  EXPECT_EQ( Sorted( diff.added ), ( Strings{ "baz", "foo", "qux" } ) );
+
+  // Opening a block comment hides the following lines, even though they
+  // haven't changed...
+  diff = index.Update( "foo /* bar\nbaz \"zoo\"\nqux" );
+  EXPECT_TRUE( diff.added.empty() );
+  EXPECT_EQ( Sorted( diff.removed ), ( Strings{ "baz", "qux" } ) );
+  EXPECT_EQ( LineIdentifiers( index, 3 ), Strings{} );
+
+  // ...until it is closed
+  diff = index.Update( "foo /* bar\nbaz */ \"zoo\"\nqux" );
+  EXPECT_EQ( Sorted( diff.added ), Strings{ "qux" } );
+  EXPECT_TRUE( diff.removed.empty() );
+
+  diff = index.Update( "foo // bar\nbaz */ \"zoo\"\nqux" );
+  EXPECT_EQ( Sorted( diff.added ), Strings{ "baz" } );
+  EXPECT_TRUE( diff.removed.empty() );
+  EXPECT_EQ( LineIdentifiers( index, 2 ), Strings{ "baz" } );
+
+  BufferTokenIndex rebuilt( IdentifierLexerForFiletype( "cpp" ),
+                            &CommentAndStringLexerForFiletype( "cpp" ) );
+  rebuilt.Update( "foo // bar\nbaz */ \"zoo\"\nqux" );
+  EXPECT_EQ( Sorted( index.Identifiers() ), Sorted( rebuilt.Identifiers() ) );
+}
+
+TEST( BufferTokenIndexTest, IdentifierAtCursor )
+{
+  BufferTokenIndex index( IdentifierLexerForFiletype( "foo" ) );
+  index.Update( "\na walk in the park" );
+
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 1 ), "a" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 2 ), "walk" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 6 ), "walk" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 16 ), "park" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 19 ), "" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 2, 20 ), "" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 1, 1 ), "" );
+  EXPECT_EQ( IdentifierUnderCursor( index, 3, 1 ), "" );
+
+  EXPECT_EQ( IdentifierBeforeCursor( index, 2, 1 ), "" );
+  EXPECT_EQ( IdentifierBeforeCursor( index, 2, 2 ), "a" );
+  EXPECT_EQ( IdentifierBeforeCursor( index, 2, 7 ), "walk" );
+  EXPECT_EQ( IdentifierBeforeCursor( index, 2, 19 ), "park" );
+  EXPECT_EQ( IdentifierBeforeCursor( index, 2, 20 ), "" );
+}
+
+TEST( BufferTokenIndexTest, RequestsReadTheirBuffer )
+{
+  EXPECT_EQ( IdentifierUnderCursor( MakeRequest( "/foo", "foo", "a\nfoo-bar",
+                                                 2, 2 ) ),
+             "foo" );
+  // Edited, so only the changed line is lexed again
+  EXPECT_EQ( IdentifierUnderCursor( MakeRequest( "/foo", "foo", "a\nbaz-bar",
+                                                 2, 2 ) ),
+             "baz" );
+  EXPECT_EQ( IdentifierBeforeCursor( MakeRequest( "/foo", "foo", "a\nbaz-bar",
+                                                  2, 8 ) ),
+             "bar" );
+
+  // Another buffer, and then the first one as a filetype whose identifiers
+  // differ
+  EXPECT_EQ( IdentifierUnderCursor( MakeRequest( "/bar", "foo", "qux",
+                                                 1, 1 ) ),
+             "qux" );
+  EXPECT_EQ( IdentifierUnderCursor( MakeRequest( "/foo", "css", "a\nbaz-bar",
+                                                 2, 2 ) ),
+             "baz-bar" );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
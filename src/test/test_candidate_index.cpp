@@ -0,0 +1,208 @@
+#include "core/Candidate.h"
+#include "core/CandidateIndex.h"
+#include "core/Repository.h"
+#include "core/Result.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  using Candidates = Repository< Candidate >;
+
+  std::vector<std::string> Identifiers( std::string_view prefix, size_t count )
+  {
+    std::vector<std::string> identifiers;
+    for ( size_t i = 0; i < count; ++i )
+    {
+      identifiers.push_back( std::string( prefix ) + "_identifier_" +
+                             std::to_string( i ) );
+    }
+    return identifiers;
+  }
+
+  std::vector<std::string_view> Views( const std::vector<std::string>& strings )
+  {
+    return { strings.begin(), strings.end() };
+  }
+
+  // The repository is a singleton, so each test starts from empty.
+  class CandidateIndexTest : public testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      Candidates::Instance().ClearElements();
+    }
+
+    void TearDown() override
+    {
+      Candidates::Instance().SetMemoryBudget( 0 );
+      Candidates::Instance().ClearElements();
+    }
+  };
+}
+
+TEST_F( CandidateIndexTest, CountsOccurrences )
+{
+  auto candidates = Candidates::Instance().GetElements( Identifiers( "foo",
+                                                                     3 ) );
+  CandidateIndex index;
+  index.Add( candidates );
+  index.Add( { candidates.begin(), candidates.begin() + 1 } );
+  EXPECT_EQ( index.Size(), 3 );
+
+  index.Remove( candidates );
+  EXPECT_EQ( index.Size(), 1 );
+  index.Remove( candidates );
+  EXPECT_EQ( index.Size(), 0 );
+}
+
+TEST_F( CandidateIndexTest, MergesDeltaIntoBase )
+{
+  auto candidates = Candidates::Instance().GetElements( Identifiers( "foo",
+                                                                     5000 ) );
+  CandidateIndex index;
+  index.Add( candidates );
+  EXPECT_EQ( index.BaseSize(), 5000 );
+  EXPECT_EQ( index.DeltaSize(), 0 );
+
+  // Small changes stay in the delta, and the base keeps what was removed from
+  // it until the next merge.
+  CandidateIndex::Candidates first_ten( candidates.data(), 10 );
+  index.Remove( first_ten );
+  index.Add( { candidates.begin() + 1, candidates.begin() + 2 } );
+  auto more = Candidates::Instance().GetElements( Identifiers( "bar", 10 ) );
+  index.Add( more );
+  EXPECT_EQ( index.BaseSize(), 5000 );
+  EXPECT_EQ( index.DeltaSize(), 10 );
+  EXPECT_EQ( index.Size(), 5001 );
+
+  std::vector<const Candidate*> visited;
+  index.ForEach( [ & ]( const Candidate* candidate ) {
+    visited.push_back( candidate );
+  } );
+  std::vector<const Candidate*> expected( candidates.begin() + 10,
+                                          candidates.end() );
+  expected.push_back( candidates[ 1 ] );
+  expected.insert( expected.end(), more.begin(), more.end() );
+  std::sort( visited.begin(), visited.end() );
+  std::sort( expected.begin(), expected.end() );
+  EXPECT_EQ( visited, expected );
+
+  // Lots of changes are merged.
+  index.Remove( { candidates.begin() + 10, candidates.begin() + 3000 } );
+  EXPECT_EQ( index.BaseSize(), 2011 );
+  EXPECT_EQ( index.DeltaSize(), 0 );
+  EXPECT_EQ( index.Size(), 2011 );
+}
+
+TEST_F( CandidateIndexTest, PrefilterOnlyRejectsNonMatches )
+{
+  std::vector<std::string> identifiers{ "", "_", "a", "A_b", "über", "x9" };
+  const std::vector<std::string> pieces{ "a", "B", "_", "9", "é", "-", "z" };
+  for ( size_t i = 0; i < 3000; ++i )
+  {
+    std::string identifier;
+    for ( size_t n = i; n; n /= pieces.size() )
+    {
+      identifier += pieces[ n % pieces.size() ];
+    }
+    identifiers.push_back( identifier );
+  }
+  auto candidates = Candidates::Instance().GetElements( Views( identifiers ) );
+  CandidateIndex index;
+  index.Add( candidates );
+  ASSERT_GT( index.BaseSize(), 0 );
+  // Some of them are gone from the base, and some are in the delta.
+  index.Remove( { candidates.begin() + 100, candidates.begin() + 200 } );
+  index.Add( { candidates.begin() + 150, candidates.begin() + 160 } );
+  auto added = Candidates::Instance().GetElements(
+    Views( Identifiers( "aé", 20 ) ) );
+  index.Add( added );
+  ASSERT_GT( index.DeltaSize(), 0 );
+
+  for ( const char* text : { "", "a", "A", "b_", "9z", "ü", "aaa", "-",
+                             "zzzzzzzzzzzzzzzz" } )
+  {
+    Word query( text );
+    std::vector<const Candidate*> expected;
+    // Empty candidates are never completed, even for an empty query.
+    index.ForEach( [ & ]( const Candidate* candidate ) {
+      if ( !candidate->IsEmpty() &&
+           candidate->QueryMatchResult( query ).IsSubsequence() )
+      {
+        expected.push_back( candidate );
+      }
+    } );
+    std::vector<const Candidate*> actual;
+    index.ForEachPossibleMatch( query, [ & ]( const Candidate* candidate ) {
+      if ( candidate->QueryMatchResult( query ).IsSubsequence() )
+      {
+        actual.push_back( candidate );
+      }
+    } );
+    std::sort( expected.begin(), expected.end() );
+    std::sort( actual.begin(), actual.end() );
+    EXPECT_EQ( actual, expected ) << "query: " << text;
+
+    // Ranges which don't line up with the blocks, or with the delta, see each
+    // candidate once between them.
+    size_t end = index.NumPositions();
+    const std::vector<size_t> bounds{ 0, 5, 13, 1003, end - 7, end - 2, end };
+    std::vector<const Candidate*> split;
+    for ( size_t i = 0; i + 1 < bounds.size(); ++i )
+    {
+      index.ForEachPossibleMatch(
+        query, bounds[ i ], bounds[ i + 1 ],
+        [ & ]( const Candidate* candidate ) {
+          if ( candidate->QueryMatchResult( query ).IsSubsequence() )
+          {
+            split.push_back( candidate );
+          }
+        } );
+    }
+    std::sort( split.begin(), split.end() );
+    EXPECT_EQ( split, expected ) << "query: " << text;
+  }
+}
+
+TEST_F( CandidateIndexTest, RefreshesCandidatesAtGoneAddresses )
+{
+  // Enough to be merged into the base
+  auto& repository = Candidates::Instance();
+  auto candidates = repository.AcquireElements( Identifiers( "foo", 2000 ) );
+  CandidateIndex index;
+  index.Add( candidates );
+  ASSERT_EQ( index.BaseSize(), 2000 );
+
+  const Candidate* gone = candidates[ 0 ];
+  index.Remove( { &gone, 1 } );
+  repository.ReleaseElements( { gone } );
+  repository.SetMemoryBudget( 1 );
+  EXPECT_EQ( repository.Trim(), 1 );
+
+  // The arena reuses the trimmed candidate's storage.
+  auto bar = repository.GetElements( std::vector<std::string>{ "bar" } );
+  ASSERT_EQ( bar[ 0 ], gone );
+  index.Add( bar );
+  EXPECT_EQ( index.BaseSize(), 2000 );
+
+  std::vector<const Candidate*> matches;
+  Word query( "ba" );
+  index.ForEachPossibleMatch( query, [ & ]( const Candidate* candidate ) {
+    matches.push_back( candidate );
+  } );
+  EXPECT_EQ( matches, bar );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
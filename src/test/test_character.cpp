@@ -0,0 +1,41 @@
+#include "core/Character.h"
+#include "core/Word.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace YouCompleteMe;
+
+TEST( CharacterTest, CharactersCompareLikeTheirStrings )
+{
+  // Enough distinct characters for their strings to take a few of the string
+  // table's segments.
+  std::string text = "aAbBeEéÉ_-1üÜßẞﬀ";
+  for ( char32_t code_point = 0xC0; code_point < 0x180; ++code_point )
+  {
+    text += static_cast<char>( 0xC0 | ( code_point >> 6 ) );
+    text += static_cast<char>( 0x80 | ( code_point & 0x3F ) );
+  }
+  Word word( text );
+  const auto& characters = word.Characters();
+  ASSERT_GT( characters.size(), 200 );
+
+  for ( const Character* first : characters )
+  {
+    for ( const Character* second : characters )
+    {
+      SCOPED_TRACE( first->Normal() + " / " + second->Normal() );
+      ASSERT_EQ( *first == *second, first->Normal() == second->Normal() );
+      ASSERT_EQ( first->EqualsBase( *second ),
+                 first->Base() == second->Base() );
+      ASSERT_EQ( first->EqualsIgnoreCase( *second ),
+                 first->FoldedCase() == second->FoldedCase() );
+    }
+  }
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
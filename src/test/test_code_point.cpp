@@ -0,0 +1,84 @@
+#include "core/CodePoint.h"
+#include "core/Repository.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+TEST( CodePointTest, MalformedTextIsRejected )
+{
+  // A lone continuation byte, truncated code points, overlong encodings, a
+  // surrogate, and code points past U+10FFFF
+  for ( const char* text : { "\x80", "a\xC3", "\xC3(", "\xC0\xAF",
+                             "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+                             "\xF8\x88\x80\x80\x80", "\xE2\x82" } )
+  {
+    SCOPED_TRACE( text );
+    EXPECT_THROW( BreakIntoCodePoints( text ), UnicodeDecodeError );
+    EXPECT_FALSE( IsValidUtf8( text ) );
+  }
+}
+
+TEST( CodePointTest, CodePointsOfEveryLengthAreDecoded )
+{
+  // The shortest and longest code points of each length
+  const std::vector<std::string> texts{
+    "\x7F", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xEF\xBF\xBF",
+    "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF" };
+
+  std::string text;
+  for ( const auto& code_point : texts )
+  {
+    text += code_point;
+  }
+  EXPECT_TRUE( IsValidUtf8( text ) );
+  auto code_points = BreakIntoCodePoints( text );
+  ASSERT_EQ( code_points.size(), texts.size() );
+  for ( size_t i = 0; i < texts.size(); ++i )
+  {
+    EXPECT_EQ( code_points[ i ]->Normal(), texts[ i ] );
+  }
+}
+
+TEST( CodePointTest, CodePointsAreLookedUpInTheTable )
+{
+  const CodePoint* upper = BreakIntoCodePoints( "É" )[ 0 ];
+  EXPECT_EQ( upper->Normal(), "E\xCC\x81" );
+  EXPECT_EQ( upper->SwappedCase(), "e\xCC\x81" );
+  EXPECT_TRUE( upper->IsLetter() );
+  EXPECT_TRUE( upper->IsUppercase() );
+
+  // A noncharacter isn't in the table, so is its own everything.
+  const CodePoint* missing = BreakIntoCodePoints( "\xF4\x8F\xBF\xBF" )[ 0 ];
+  EXPECT_EQ( missing->Normal(), "\xF4\x8F\xBF\xBF" );
+  EXPECT_EQ( missing->FoldedCase(), "\xF4\x8F\xBF\xBF" );
+  EXPECT_FALSE( missing->IsLetter() );
+  EXPECT_EQ( missing->GetBreakProperty(), BreakProperty::OTHER );
+}
+
+TEST( CodePointTest, CodePointsComeFromTheRepository )
+{
+  // More code points than are kept inline
+  std::string text;
+  for ( int i = 0; i < 40; ++i )
+  {
+    text += "aé€𝄞";
+  }
+  auto code_points = BreakIntoCodePoints( text );
+  ASSERT_EQ( code_points.size(), 160 );
+
+  auto expected = Repository<CodePoint>::Instance().GetElements(
+    std::vector<std::string>{ "a", "é", "€", "𝄞" } );
+  for ( size_t i = 0; i < code_points.size(); ++i )
+  {
+    EXPECT_EQ( code_points[ i ], expected[ i % 4 ] );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,223 @@
+#include "core/Candidate.h"
+#include "core/IdentifierCompleter.h"
+#include "core/Repository.h"
+#include "core/Result.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  using Candidates = Repository< Candidate >;
+
+  std::vector<std::string> Identifiers( std::string_view prefix, size_t count )
+  {
+    std::vector<std::string> identifiers;
+    for ( size_t i = 0; i < count; ++i )
+    {
+      identifiers.push_back( std::string( prefix ) + "_identifier_" +
+                             std::to_string( i ) );
+    }
+    return identifiers;
+  }
+
+  std::vector<std::string_view> Views( const std::vector<std::string>& strings )
+  {
+    return { strings.begin(), strings.end() };
+  }
+
+  // The repository is a singleton, so each test starts from empty.
+  class IdentifierCompleterTest : public testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      Candidates::Instance().ClearElements();
+    }
+
+    void TearDown() override
+    {
+      Candidates::Instance().SetMemoryBudget( 0 );
+      Candidates::Instance().ClearElements();
+    }
+  };
+}
+
+TEST_F( IdentifierCompleterTest, SplitsQueriesBetweenThreads )
+{
+  std::vector<std::string> identifiers;
+  for ( const char* prefix : { "foo", "Foo", "barBaz", "bar_foo" } )
+  {
+    auto more = Identifiers( prefix, 25000 );
+    identifiers.insert( identifiers.end(), more.begin(), more.end() );
+  }
+  IdentifierCompleter sequential;
+  sequential.ClearForFileAndAddIdentifiersToDatabase(
+    Views( identifiers ), "cpp", "/foo.cpp" );
+  IdentifierCompleter parallel;
+  parallel.ClearForFileAndAddIdentifiersToDatabase(
+    Views( identifiers ), "cpp", "/foo.cpp" );
+
+  std::atomic<size_t> num_tasks_run = 0;
+  parallel.SetParallelFor(
+    [ & ]( size_t num_tasks, const std::function<void( size_t )>& task ) {
+      std::vector<std::thread> threads;
+      for ( size_t i = 0; i < num_tasks; ++i )
+      {
+        threads.emplace_back( [ &, i ]() {
+          task( i );
+          ++num_tasks_run;
+        } );
+      }
+      for ( auto& thread : threads )
+      {
+        thread.join();
+      }
+    },
+    4 );
+
+  for ( const char* query : { "", "f", "fb", "bfi9", "Fi_12", "zzz" } )
+  {
+    for ( size_t max_candidates : { 0, 1, 10, 1000 } )
+    {
+      EXPECT_EQ( parallel.CandidatesForQueryAndType( query,
+                                                     "cpp",
+                                                     max_candidates ),
+                 sequential.CandidatesForQueryAndType( query,
+                                                       "cpp",
+                                                       max_candidates ) )
+        << "query: " << query << ", max: " << max_candidates;
+    }
+  }
+  EXPECT_GT( num_tasks_run, 0 );
+}
+
+TEST_F( IdentifierCompleterTest, BestCandidatesAreTheFirstOfAll )
+{
+  const std::vector<std::string> words{ "get", "Set", "buffer", "Line",
+                                        "_", "fooBar", "BAZ", "qux9" };
+  std::vector<std::string> identifiers;
+  for ( size_t i = 0; i < 5000; ++i )
+  {
+    std::string identifier;
+    for ( size_t n = i + 1; n; n /= words.size() )
+    {
+      identifier += words[ n % words.size() ];
+    }
+    identifiers.push_back( identifier );
+  }
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    Views( identifiers ), "cpp", "/foo.cpp" );
+
+  for ( const char* query : { "", "g", "gsl", "fb", "SB", "bLq", "_9" } )
+  {
+    auto all = completer.CandidatesForQueryAndType( query, "cpp" );
+    for ( size_t max_candidates : { 1, 2, 10, 100 } )
+    {
+      std::vector<std::string> best( all.begin(),
+                                     all.begin() + static_cast< ptrdiff_t >(
+                                       std::min( max_candidates,
+                                                 all.size() ) ) );
+      EXPECT_EQ( completer.CandidatesForQueryAndType( query,
+                                                      "cpp",
+                                                      max_candidates ),
+                 best )
+        << "query: " << query << ", max: " << max_candidates;
+    }
+
+    // A result's upper bound never ranks below it.
+    Word query_word( query );
+    auto candidates =
+      Candidates::Instance().GetElements( Views( identifiers ) );
+    for ( const Candidate* candidate : candidates )
+    {
+      Result result = candidate->QueryMatchResult( query_word );
+      if ( result.IsSubsequence() )
+      {
+        Result bound = Result::UpperBound( candidate,
+                                           &query_word,
+                                           result.CharMatchIndexSum(),
+                                           result.QueryIsCandidatePrefix() );
+        EXPECT_FALSE( result < bound ) << candidate->Text();
+      }
+    }
+  }
+}
+
+TEST_F( IdentifierCompleterTest, NarrowsQueriesAsTheyAreTyped )
+{
+  std::vector<std::string> identifiers{ "getBuffer", "get_buffer_line",
+                                        "GetBuf", "gbx", "égal", "eglise",
+                                        "buffer" };
+  for ( const char* prefix : { "get", "set", "geta" } )
+  {
+    auto more = Identifiers( prefix, 200 );
+    identifiers.insert( identifiers.end(), more.begin(), more.end() );
+  }
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    Views( identifiers ), "cpp", "/foo.cpp" );
+
+  // Each query is checked against a completer which has seen no other query.
+  auto expect_candidates = [ & ]( const char* query )
+  {
+    IdentifierCompleter fresh;
+    fresh.ClearForFileAndAddIdentifiersToDatabase(
+      Views( identifiers ), "cpp", "/foo.cpp" );
+    for ( size_t max_candidates : { 0, 5 } )
+    {
+      EXPECT_EQ( completer.CandidatesForQueryAndType( query,
+                                                      "cpp",
+                                                      max_candidates ),
+                 fresh.CandidatesForQueryAndType( query,
+                                                  "cpp",
+                                                  max_candidates ) )
+        << "query: " << query << ", max: " << max_candidates;
+    }
+  };
+
+  // Typing, deleting characters, and queries which don't start with the last
+  // one; "e" followed by a combining accent is a different character.
+  for ( const char* query : { "", "g", "ge", "get", "getb", "getbu", "get",
+                              "gb", "gbx", "gbxy", "x", "e", "e\xCC\x81",
+                              "e\xCC\x81g", "É" } )
+  {
+    expect_candidates( query );
+  }
+
+  // Changes to the identifiers are seen by queries which start with the last
+  // one.
+  expect_candidates( "getb" );
+  identifiers.push_back( "getbuffer_new" );
+  completer.AddSingleIdentifierToDatabase( "getbuffer_new", "cpp", "/foo.cpp" );
+  expect_candidates( "getbu" );
+
+  identifiers.erase( std::find( identifiers.begin(),
+                                identifiers.end(),
+                                "getBuffer" ) );
+  completer.UpdateIdentifiersInDatabase( {},
+                                         { "getBuffer" },
+                                         "cpp",
+                                         "/foo.cpp" );
+  expect_candidates( "getbuf" );
+
+  identifiers.erase( identifiers.begin() + 100, identifiers.end() );
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    Views( identifiers ), "cpp", "/foo.cpp" );
+  expect_candidates( "getbuff" );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,203 @@
+#include "core/Candidate.h"
+#include "core/IdentifierCompleter.h"
+#include "core/IdentifierDatabase.h"
+#include "core/Repository.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  using Candidates = Repository< Candidate >;
+
+  std::vector<std::string> Identifiers( std::string_view prefix, size_t count )
+  {
+    std::vector<std::string> identifiers;
+    for ( size_t i = 0; i < count; ++i )
+    {
+      identifiers.push_back( std::string( prefix ) + "_identifier_" +
+                             std::to_string( i ) );
+    }
+    return identifiers;
+  }
+
+  std::vector<std::string_view> Views( const std::vector<std::string>& strings )
+  {
+    return { strings.begin(), strings.end() };
+  }
+
+  // The repository is a singleton, so each test starts from empty.
+  class IdentifierDatabaseTest : public testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      Candidates::Instance().ClearElements();
+    }
+
+    void TearDown() override
+    {
+      Candidates::Instance().SetMemoryBudget( 0 );
+      Candidates::Instance().ClearElements();
+    }
+  };
+}
+
+TEST_F( IdentifierDatabaseTest, DeduplicatesAcrossFiles )
+{
+  IdentifierCompleter completer;
+  for ( const char* filepath : { "/foo.cpp", "/bar.cpp", "/baz.cpp" } )
+  {
+    completer.ClearForFileAndAddIdentifiersToDatabase(
+      std::vector<std::string>{ "shared", "shared_too", filepath },
+      "cpp",
+      filepath );
+  }
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sha", "cpp" ),
+             ( std::vector<std::string>{ "shared", "shared_too" } ) );
+
+  // A candidate leaves the view with its last file.
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "shared" }, "cpp", "/foo.cpp" );
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "shared" }, "cpp", "/bar.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sha", "cpp" ),
+             ( std::vector<std::string>{ "shared", "shared_too" } ) );
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "shared" }, "cpp", "/baz.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sha", "cpp" ),
+             ( std::vector<std::string>{ "shared" } ) );
+}
+
+TEST_F( IdentifierDatabaseTest, ReleasesRemovedIdentifiers )
+{
+  auto& repository = Candidates::Instance();
+  auto identifiers = Identifiers( "foo", 10 );
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase( Views( identifiers ),
+                                                     "cpp",
+                                                     "/foo.cpp" );
+  completer.AddSingleIdentifierToDatabase( "bar", "cpp", "/foo.cpp" );
+  completer.AddSingleIdentifierToDatabase( "bar", "cpp", "/foo.cpp" );
+  repository.GetElements( Identifiers( "borrowed", 10 ) );
+
+  repository.SetMemoryBudget( 1 );
+  EXPECT_EQ( repository.Trim(), 10 );
+  EXPECT_EQ( repository.NumStoredElements(), 11 );
+
+  completer.UpdateIdentifiersInDatabase( { "baz" },
+                                         { "foo_identifier_0", "bar" },
+                                         "cpp",
+                                         "/foo.cpp" );
+  EXPECT_EQ( repository.Trim(), 2 );
+  EXPECT_EQ( repository.NumStoredElements(), 10 );
+
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "qux" },
+    "cpp",
+    "/foo.cpp" );
+  EXPECT_EQ( repository.Trim(), 10 );
+  EXPECT_EQ( repository.NumStoredElements(), 1 );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "qu", "cpp" ),
+             std::vector<std::string>{ "qux" } );
+}
+
+TEST_F( IdentifierDatabaseTest, ReleasesLongIdentifiers )
+{
+  // Too long to be a candidate of its own, so it's the empty one.
+  auto& repository = Candidates::Instance();
+  std::string long_identifier( 100, 'x' );
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "foo", long_identifier },
+    "cpp",
+    "/foo.cpp" );
+  EXPECT_EQ( repository.NumStoredElements(), 2 );
+
+  // Harvesting the buffer again, e.g. each time it changes
+  for ( int i = 0; i < 5; ++i )
+  {
+    completer.UpdateIdentifiersInDatabase( { long_identifier },
+                                           { long_identifier },
+                                           "cpp",
+                                           "/foo.cpp" );
+    EXPECT_EQ( repository.NumStoredElements(), 2 );
+  }
+
+  completer.UpdateIdentifiersInDatabase( {},
+                                         { long_identifier },
+                                         "cpp",
+                                         "/foo.cpp" );
+  repository.SetMemoryBudget( 1 );
+  EXPECT_EQ( repository.Trim(), 1 );
+  EXPECT_EQ( repository.NumStoredElements(), 1 );
+}
+
+TEST_F( IdentifierDatabaseTest, KeepsIdentifiersInOtherFiles )
+{
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "shared", "only_foo" }, "cpp", "/foo.cpp" );
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "shared", "only_bar" }, "cpp", "/bar.cpp" );
+
+  completer.UpdateIdentifiersInDatabase( {},
+                                         { "shared", "only_foo" },
+                                         "cpp",
+                                         "/foo.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "o", "cpp" ),
+             std::vector<std::string>{ "only_bar" } );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sh", "cpp" ),
+             std::vector<std::string>{ "shared" } );
+
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{}, "cpp", "/bar.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sh", "cpp" ),
+             std::vector<std::string>{} );
+  completer.AddSingleIdentifierToDatabase( "shared", "cpp", "/foo.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "sh", "cpp" ),
+             std::vector<std::string>{ "shared" } );
+}
+
+TEST_F( IdentifierDatabaseTest, KeepsTagsApartFromBuffers )
+{
+  IdentifierCompleter completer;
+  completer.ClearForFileAndAddIdentifiersToDatabase(
+    std::vector<std::string>{ "buffer_only", "edited" }, "cpp", "/foo.cpp" );
+  // A tag file which names the open buffer
+  FiletypeIdentifierMap tags;
+  tags[ "cpp" ][ "/foo.cpp" ] = { "tag_only" };
+  completer.AddIdentifiersToDatabaseFromTagFiles( std::move( tags ) );
+
+  // Edits only apply the difference to the buffer's identifiers.
+  completer.UpdateIdentifiersInDatabase( { "added" },
+                                         { "edited" },
+                                         "cpp",
+                                         "/foo.cpp" );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "buffer", "cpp" ),
+             std::vector<std::string>{ "buffer_only" } );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "tag", "cpp" ),
+             std::vector<std::string>{ "tag_only" } );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "added", "cpp" ),
+             std::vector<std::string>{ "added" } );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "edited", "cpp" ),
+             std::vector<std::string>{} );
+
+  // and new tags don't drop them either.
+  completer.AddIdentifiersToDatabaseFromTagFiles(
+    FiletypeIdentifierMap{ { "cpp", { { "/foo.cpp", {} } } } } );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "tag", "cpp" ),
+             std::vector<std::string>{} );
+  EXPECT_EQ( completer.CandidatesForQueryAndType( "buffer", "cpp" ),
+             std::vector<std::string>{ "buffer_only" } );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
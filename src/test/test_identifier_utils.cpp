@@ -1,7 +1,8 @@
-#include "../identifier_utils.cpp"
+#include "../buffer_token_index.cpp"
 #include "gtest/gtest.h"
 #include <gtest/gtest.h>
 #include <initializer_list>
+#include <random>
 #include <string>
 #include <string_view>
 
@@ -156,6 +157,288 @@ INSTANTIATE_POS_STRING_TEST(
 
 #undef INSTANTIATE_POS_STRING_TEST
 
+TEST( StartOfLongestIdentifierEndingAtTest, DefaultFiletype )
+{
+  const auto& lexer = IdentifierLexerForFiletype( "foo" );
+
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 1, lexer, U"" ), 1 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 1, lexer, U"foo" ), 1 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 4, lexer, U"foo" ), 1 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 8, lexer, U"foo.bar" ), 5 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 5, lexer, U"foo.bar" ), 5 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 4, lexer, U"a_b c" ), 1 );
+
+  // Digits can't start an identifier, but the longest identifier still wins
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 5, lexer, U"foo1" ), 1 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 7, lexer, U"123abc" ), 4 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 3, lexer, U"12" ), 3 );
+
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 8, lexer, U"fóó bår" ), 5 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 8, lexer, U"x = αβγ" ), 5 );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 7, lexer, U"x = ٣γ" ), 6 );
+
+  std::u32string long_line( 10000, U'a' );
+  EXPECT_EQ( StartOfLongestIdentifierEndingAt( 10001, lexer, long_line ), 1 );
+}
+
+namespace
+{
+  struct IsIdentifierTest : testing::TestWithParam<std::tuple<
+    std::string_view, // filetype
+    std::string_view, // text
+    bool              // is identifier
+  >> {};
+
+  TEST_P( IsIdentifierTest, Matches )
+  {
+    auto [ filetype, text, expected ] = GetParam();
+    const auto& lexer = IdentifierLexerForFiletype( filetype );
+    EXPECT_EQ( IsIdentifier( lexer, text ), expected ) << text;
+
+    auto u32 = ztd::text::decode( text, ztd::text::utf8 );
+    EXPECT_EQ( IsIdentifier( lexer, std::u32string_view{ u32 } ), expected )
+      << text;
+  }
+}
+
+#define INSTANTIATE_IS_IDENTIFIER_TEST( name, filetype, valid, invalid ) \
+  INSTANTIATE_TEST_SUITE_P( \
+    name##Valid, \
+    IsIdentifierTest, \
+    testing::Combine( \
+      testing::Values( filetype ), \
+      testing::ValuesIn( std::initializer_list<std::string_view> valid ), \
+      testing::Values( true ) ) ); \
+  INSTANTIATE_TEST_SUITE_P( \
+    name##Invalid, \
+    IsIdentifierTest, \
+    testing::Combine( \
+      testing::Values( filetype ), \
+      testing::ValuesIn( std::initializer_list<std::string_view> invalid ), \
+      testing::Values( false ) ) );
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Default,
+  "foo",
+  ( { "foo", "foo129", "f12", "_foo", "_foo129", "http", "fóó", "αβγ" } ),
+  ( { "", "1foo", "-foo", "foo-", "font-face", "foo bar", "$foo" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Css,
+  "css",
+  ( { "foo", "a1", "a-", "a-b", "_b", "-ms-foo", "-_o", "font-face", "αβγ" } ),
+  ( { "", "-3b", "-", "3", "a$", "--foo" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Html,
+  "html",
+  ( { "foo", "a1", "a-", "a-b", "font-face", "data:foo", "x$y" } ),
+  ( { "", "3", "-foo", "_a", "a/b", "a=b", "a.b", "a}", "a{", "a b" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  R,
+  "r",
+  ( { "a", "a.b", "a.b.c", "a_b", "a1", "a_1", ".a", ".a_b", ".a1", "...",
+      "..1", ".", "._" } ),
+  ( { "", "1b", "_a", ".1a", "a$", "a-b" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Clojure,
+  "clojure",
+  ( { "foo", "f9", "a.b.c", "a.c", "a/c", "*", "a*b", "?", "a?b", ":", "a:b",
+      "+", "a+b", "-", "a-b", "!", "a!b" } ),
+  ( { "", "9f", "9", "a/b/c", "(a)" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Haskell,
+  "haskell",
+  ( { "foo", "foo'", "x'", "_x", "x_", "_x'", "x9", "x'y" } ),
+  ( { "", "x", "'x", "9x", "9", "x-y" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Tex,
+  "tex",
+  ( { "foo", "fig:foo", "fig:foo-bar", "sec:summary", "eq:bar_foo", "fōo",
+      "a" } ),
+  ( { "", "\\section", ":foo", "fig:", "-bar", "foo-", "9a" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Perl6,
+  "perl6",
+  ( { "foo", "f-o", "x'y", "_x-y", "x-y'a", "x-y", "x_", "x-_" } ),
+  ( { "", "x'", "x-", "-x", "'x", "9x", "x--y", "x-'y" } ) )
+
+INSTANTIATE_IS_IDENTIFIER_TEST(
+  Scheme,
+  "scheme",
+  ( { "λ", "_", "+", "-", "...", "->", "<=?", "->x", "x->", "\\x41;",
+      "\\x41;bar", "foo\\x41;", "list->vector", "call/cc", "set!", "a1" } ),
+  ( { "", "123", "1+", "..", "+a", "-a", "@", "a'", "\\x41", "\\xg;" } ) )
+
+#undef INSTANTIATE_IS_IDENTIFIER_TEST
+
+TEST( IdentifiersFromBufferTest, Filetypes )
+{
+  auto identifiers = []( std::string filetype, std::string contents ) {
+    api::SimpleRequest::FileData file;
+    file.filetypes = { std::move( filetype ) };
+    file.contents = std::move( contents );
+    auto identifiers = IdentifiersFromBuffer( file, true );
+    return std::vector<std::string>( identifiers.begin(), identifiers.end() );
+  };
+
+  using V = std::vector<std::string>;
+  EXPECT_EQ( identifiers( "foo", "" ), V{} );
+  EXPECT_EQ( identifiers( "foo", "foo.bar(baz, 1 + qux_2)\n\t123abc" ),
+             ( V{ "foo", "bar", "baz", "qux_2", "abc" } ) );
+  EXPECT_EQ( identifiers( "foo", "fóó = αβγ.δ" ),
+             ( V{ "fóó", "αβγ", "δ" } ) );
+  EXPECT_EQ( identifiers( "css", ".foo-bar { -moz-border: 1px }" ),
+             ( V{ "foo-bar", "-moz-border", "px" } ) );
+  EXPECT_EQ( identifiers( "html", "<div class=\"foo-bar\">{{x}}</div>" ),
+             ( V{ "div", "class", "foo-bar", "x" } ) );
+  EXPECT_EQ( identifiers( "haskell", "f x' = foldl' (+) x'" ),
+             ( V{ "x'", "foldl'" } ) );
+  EXPECT_EQ( identifiers( "tex", "\\label{fig:foo-bar}" ),
+             ( V{ "label", "fig:foo-bar" } ) );
+  EXPECT_EQ( identifiers( "scheme", "(define (f->g x) (+ x 1))" ),
+             ( V{ "define", "f->g", "x", "+" } ) );
+
+  // Invalid UTF-8 is skipped over, rather than derailing the lexer
+  EXPECT_EQ( identifiers( "foo", "foo \xff\xfe bar \xc3" ),
+             ( V{ "foo", "bar" } ) );
+}
+
+TEST( IdentifiersFromBufferTest, SkipsCommentsAndStrings )
+{
+  auto identifiers = []( std::string filetype, std::string contents ) {
+    api::SimpleRequest::FileData file;
+    file.filetypes = { std::move( filetype ) };
+    file.contents = std::move( contents );
+    auto identifiers = IdentifiersFromBuffer( file, false );
+    return std::vector<std::string>( identifiers.begin(), identifiers.end() );
+  };
+
+  using V = std::vector<std::string>;
+
+  // c-like
+  EXPECT_EQ( identifiers( "cpp", "foo // bar\nbaz" ), ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo /* bar\n zoo */ baz" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo/* bar */baz" ), ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo /*/ bar */ baz" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo \"bar // zoo\" baz // qux" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo 'bar' \"zoo\" baz" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo #bar" ), ( V{ "foo", "bar" } ) );
+  EXPECT_EQ( identifiers( "cpp", "/* unterminated\nfoo" ), V{} );
+
+  // Escapes
+  EXPECT_EQ( identifiers( "cpp", R"(foo "bar\"zoo" baz)" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", R"(foo "bar\\" baz "zoo")" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", R"(foo \"bar" baz)" ),
+             ( V{ "foo", "bar", "baz" } ) );
+
+  // Single-line strings must be terminated on the same line
+  EXPECT_EQ( identifiers( "cpp", "foo \"bar\nbaz\" zoo" ),
+             ( V{ "foo", "bar", "baz", "zoo" } ) );
+  EXPECT_EQ( identifiers( "rust", "let c = 'x'; // y\nz" ),
+             ( V{ "let", "c", "z" } ) );
+
+  // python
+  EXPECT_EQ( identifiers( "python", "foo # bar\nbaz" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "python", "foo '''bar\n' zoo\n''' baz" ),
+             ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "python", "foo \"\"\"bar\nzoo\"\"\" baz // qux" ),
+             ( V{ "foo", "baz", "qux" } ) );
+
+  // go
+  EXPECT_EQ( identifiers( "go", "foo `bar` baz" ), ( V{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers( "cpp", "foo `bar` baz" ),
+             ( V{ "foo", "bar", "baz" } ) );
+
+  // Everything else gets all of them
+  EXPECT_EQ( identifiers( "foo",
+                          "a // b\nc # d\ne /* f */ g '''h''' i 'j' k" ),
+             ( V{ "a", "c", "e", "g", "i", "k" } ) );
+}
+
+TEST( ClassifyBlockTest, MatchesScalar )
+{
+  AsciiByteSet set;
+  for ( char c : std::string_view{ "_-$abcxyzABCXYZ0189" } )
+  {
+    set.Add( static_cast< uint8_t >( c ) );
+  }
+
+  std::string bytes;
+  for ( int i = 0; i < 256; ++i )
+  {
+    bytes.push_back( static_cast< char >( i ) );
+  }
+
+  for ( size_t start = 0; start < bytes.size(); start += 7 )
+  {
+    auto block = std::string_view{ bytes }.substr( start );
+    uint64_t expected = 0;
+    for ( size_t i = 0; i < std::min< size_t >( block.size(), 64 ); ++i )
+    {
+      if ( set.Contains( static_cast< uint8_t >( block[ i ] ) ) )
+      {
+        expected |= uint64_t{ 1 } << i;
+      }
+    }
+    EXPECT_EQ( ClassifyBlock( block, set ), expected ) << start;
+  }
+}
+
+TEST( ForEachIdentifierTest, MatchesNextIdentifier )
+{
+  // Runs of mixed text long enough to cross many block boundaries, including
+  // multi-byte characters (and broken ones) straddling them.
+  constexpr std::string_view pieces[] = {
+    "foo", "_bar1", " ", "\n", ".", "-", "$", "'", ":", "/", "\\x41;", "9",
+    "ß", "αβγ", "٣", "😀", "\xff", "\xc3", "<=?", "{{", "}}", "->"
+  };
+
+  std::minstd_rand random( 42 );
+  for ( std::string_view filetype : { "foo", "css", "html", "r", "clojure",
+                                      "haskell", "tex", "perl6", "scheme" } )
+  {
+    const auto& lexer = IdentifierLexerForFiletype( filetype );
+    for ( size_t length : { 0, 1, 63, 64, 65, 200, 5000 } )
+    {
+      std::string text;
+      while ( text.size() < length )
+      {
+        text.append( pieces[ random() % std::size( pieces ) ] );
+      }
+
+      std::vector< std::string_view > expected;
+      size_t pos = 0;
+      for ( auto identifier = lexer.NextIdentifier( std::string_view{ text },
+                                                    pos );
+            !identifier.empty();
+            identifier = lexer.NextIdentifier( std::string_view{ text }, pos ) )
+      {
+        expected.push_back( identifier );
+      }
+
+      std::vector< std::string_view > actual;
+      lexer.ForEachIdentifier( text, [ & ]( std::string_view identifier ) {
+        actual.push_back( identifier );
+      } );
+
+      EXPECT_EQ( actual, expected ) << filetype << " " << length;
+    }
+  }
+}
+
 int main( int argc, char** argv )
 {
   testing::InitGoogleTest( &argc, argv );
@@ -0,0 +1,108 @@
+#include "core/Candidate.h"
+#include "core/QueryMatcher.h"
+#include "core/Repository.h"
+#include "core/Result.h"
+#include "core/Word.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+// The batched matcher must agree with Candidate::QueryMatchResult, which is
+// what it replaces in the identifier database.
+
+namespace
+{
+  std::vector<std::string> RandomWords( size_t count,
+                                        size_t max_length,
+                                        std::mt19937& random )
+  {
+    // Some of these differ only in case or accents, and some are more than one
+    // byte, to exercise each of the ways characters can match.
+    static const std::vector<std::string> characters{
+      "a", "A", "b", "B", "e", "E", "é", "É", "x", "_", "-", "1", "ü", "Ü",
+      "ß", "ﬀ" };
+
+    std::vector<std::string> words;
+    for ( size_t i = 0; i < count; ++i )
+    {
+      std::string word;
+      size_t length = random() % ( max_length + 1 );
+      for ( size_t j = 0; j < length; ++j )
+      {
+        word += characters[ random() % characters.size() ];
+      }
+      words.push_back( word );
+    }
+    return words;
+  }
+
+  void ExpectMatchesAgree( const Word& query,
+                           const std::vector<const Candidate*>& candidates )
+  {
+    QueryMatcher matcher( query );
+    for ( size_t first = 0; first < candidates.size(); )
+    {
+      // Batches of every size
+      size_t size = std::min( candidates.size() - first,
+                              1 + first % QueryMatcher::BATCH_SIZE );
+      std::vector<CandidateMatch> matches( size );
+      matcher.Match( { candidates.data() + first, size }, matches.data() );
+
+      for ( size_t i = 0; i < size; ++i )
+      {
+        const Candidate* candidate = candidates[ first + i ];
+        Result expected = candidate->QueryMatchResult( query );
+        SCOPED_TRACE( "query: " + query.Text() +
+                      ", candidate: " + candidate->Text() );
+        ASSERT_EQ( matches[ i ].is_subsequence, expected.IsSubsequence() );
+        if ( expected.IsSubsequence() )
+        {
+          EXPECT_EQ( matches[ i ].query_is_candidate_prefix,
+                     expected.QueryIsCandidatePrefix() );
+          EXPECT_EQ( matches[ i ].char_match_index_sum,
+                     expected.CharMatchIndexSum() );
+        }
+      }
+      first += size;
+    }
+  }
+}
+
+TEST( QueryMatcherTest, AgreesWithQueryMatchResult )
+{
+  std::mt19937 random( 1234 );
+  auto candidates = Repository<Candidate>::Instance().GetElements(
+    RandomWords( 2000, 12, random ) );
+
+  for ( const auto& text : RandomWords( 200, 4, random ) )
+  {
+    Word query( text );
+    ExpectMatchesAgree( query, candidates );
+  }
+}
+
+TEST( QueryMatcherTest, AgreesWithQueryMatchResultOnIdentifiers )
+{
+  auto candidates = Repository<Candidate>::Instance().GetElements(
+    std::vector<std::string>{
+      "", "foo", "Foo", "FOO", "fooBar", "foo_bar", "FooBar", "f", "barfoo",
+      "a_very_long_identifier_name_with_lots_of_characters_in_it",
+      "émoji_ünïcode", "ÉMOJI" } );
+
+  for ( const char* text : { "", "f", "F", "fo", "fb", "FB", "foob", "é",
+                             "e", "E", "É", "emoji", "vlin", "foo_bar_x" } )
+  {
+    Word query( text );
+    ExpectMatchesAgree( query, candidates );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+#include "core/Candidate.h"
+#include "core/Repository.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  using Candidates = Repository< Candidate >;
+
+  std::vector<std::string> Identifiers( std::string_view prefix, size_t count )
+  {
+    std::vector<std::string> identifiers;
+    for ( size_t i = 0; i < count; ++i )
+    {
+      identifiers.push_back( std::string( prefix ) + "_identifier_" +
+                             std::to_string( i ) );
+    }
+    return identifiers;
+  }
+
+  std::vector<std::string_view> Views( const std::vector<std::string>& strings )
+  {
+    return { strings.begin(), strings.end() };
+  }
+
+  // The repository is a singleton, so each test starts from empty.
+  class RepositoryTest : public testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      Candidates::Instance().ClearElements();
+    }
+
+    void TearDown() override
+    {
+      Candidates::Instance().SetMemoryBudget( 0 );
+      Candidates::Instance().ClearElements();
+    }
+  };
+}
+
+TEST_F( RepositoryTest, CountsElementsAndBytes )
+{
+  auto& repository = Candidates::Instance();
+  EXPECT_EQ( repository.NumStoredElements(), 0 );
+  EXPECT_EQ( repository.MemoryUsage(), 0 );
+
+  auto first = repository.GetElements( Identifiers( "foo", 10 ) );
+  EXPECT_EQ( repository.NumStoredElements(), 10 );
+  size_t bytes = repository.MemoryUsage();
+  EXPECT_GE( bytes, 10 * sizeof( Candidate ) );
+
+  // Nothing new
+  EXPECT_EQ( repository.GetElements( Identifiers( "foo", 10 ) ), first );
+  EXPECT_EQ( repository.MemoryUsage(), bytes );
+
+  // Long identifiers take more
+  repository.GetElements( Identifiers( std::string( 60, 'x' ), 10 ) );
+  EXPECT_EQ( repository.NumStoredElements(), 20 );
+  EXPECT_GT( repository.MemoryUsage() - bytes, bytes );
+
+  repository.ClearElements();
+  EXPECT_EQ( repository.NumStoredElements(), 0 );
+  EXPECT_EQ( repository.MemoryUsage(), 0 );
+}
+
+TEST_F( RepositoryTest, TrimOnlyWhenOverBudget )
+{
+  auto& repository = Candidates::Instance();
+  repository.GetElements( Identifiers( "foo", 100 ) );
+
+  // No budget
+  EXPECT_EQ( repository.Trim(), 0 );
+
+  repository.SetMemoryBudget( repository.MemoryUsage() );
+  EXPECT_EQ( repository.Trim(), 0 );
+  EXPECT_EQ( repository.NumStoredElements(), 100 );
+
+  repository.SetMemoryBudget( repository.MemoryUsage() / 2 );
+  EXPECT_GT( repository.Trim(), 50 );
+  EXPECT_LE( repository.MemoryUsage(), repository.MemoryBudget() );
+}
+
+TEST_F( RepositoryTest, TrimKeepsAcquiredElements )
+{
+  auto& repository = Candidates::Instance();
+  auto kept_identifiers = Identifiers( "kept", 10 );
+  auto kept = repository.AcquireElements( Views( kept_identifiers ) );
+  repository.GetElements( Identifiers( "borrowed", 100 ) );
+
+  repository.SetMemoryBudget( 1 );
+  EXPECT_EQ( repository.Trim(), 100 );
+  EXPECT_EQ( repository.NumStoredElements(), 10 );
+  EXPECT_EQ( repository.GetElements( Views( kept_identifiers ) ), kept );
+
+  // Acquired twice, so needs releasing twice
+  repository.AcquireElements( Views( kept_identifiers ) );
+  repository.ReleaseElements( kept );
+  EXPECT_EQ( repository.Trim(), 0 );
+  repository.ReleaseElements( kept );
+  EXPECT_EQ( repository.Trim(), 10 );
+  EXPECT_EQ( repository.NumStoredElements(), 0 );
+}
+
+TEST_F( RepositoryTest, TrimPrefersElementsNotUsedRecently )
+{
+  auto& repository = Candidates::Instance();
+  auto recent_identifiers = Identifiers( "recent", 100 );
+  auto old_identifiers = Identifiers( "old", 100 );
+  auto recent = repository.AcquireElements( Views( recent_identifiers ) );
+  size_t recent_bytes = repository.MemoryUsage();
+  auto old = repository.AcquireElements( Views( old_identifiers ) );
+
+  // Nothing can go, but everything is marked as not used since.
+  repository.SetMemoryBudget( 1 );
+  EXPECT_EQ( repository.Trim(), 0 );
+  repository.ReleaseElements( recent );
+  repository.ReleaseElements( old );
+
+  EXPECT_EQ( repository.GetElements( Views( recent_identifiers ) ), recent );
+  repository.SetMemoryBudget( recent_bytes * 4 / 3 + 4 );
+  EXPECT_EQ( repository.Trim(), 100 );
+  EXPECT_EQ( repository.GetElements( Views( recent_identifiers ) ), recent );
+  EXPECT_EQ( repository.NumStoredElements(), 100 );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
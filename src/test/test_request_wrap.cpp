@@ -223,6 +223,12 @@ TEST_F(Fixture, query)
   EXPECT_EQ( wrap->column_num(), 14 );
   EXPECT_EQ( wrap->query_bytes(), "båz" );
   EXPECT_EQ( wrap->query(), U"båz" );
+
+  BuildRequest( 1, 9, "tst", "test_file", "x = foo1" );
+  EXPECT_EQ( wrap->start_codepoint(), 5 );
+  EXPECT_EQ( wrap->start_column(), 5 );
+  EXPECT_EQ( wrap->query_bytes(), "foo1" );
+  EXPECT_EQ( wrap->query(), U"foo1" );
 }
 
 TEST_F( Fixture, first_filetype )
@@ -0,0 +1,231 @@
+#include "core/Candidate.h"
+#include "core/Repository.h"
+#include "core/Result.h"
+#include "core/Word.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  // The dynamic programming solution, which the bit-parallel one replaced.
+  size_t ExpectedLcsLength( const CharacterSequence& first,
+                            const CharacterSequence& second )
+  {
+    std::vector<std::vector<size_t>> lengths(
+      first.size() + 1, std::vector<size_t>( second.size() + 1, 0 ) );
+    for ( size_t i = 0; i < first.size(); ++i )
+    {
+      for ( size_t j = 0; j < second.size(); ++j )
+      {
+        lengths[ i + 1 ][ j + 1 ] =
+          first[ i ]->EqualsBase( *second[ j ] )
+          ? lengths[ i ][ j ] + 1
+          : std::max( lengths[ i ][ j + 1 ], lengths[ i + 1 ][ j ] );
+      }
+    }
+    return lengths[ first.size() ][ second.size() ];
+  }
+
+  std::string RandomText( size_t length, std::mt19937& random )
+  {
+    // Some of these have the same base, and some are more than one byte.
+    static const std::vector<std::string> characters{
+      "a", "A", "b", "B", "e", "E", "é", "É", "x", "_", "1", "ü", "ß", "ﬀ" };
+
+    std::string text;
+    for ( size_t i = 0; i < length; ++i )
+    {
+      text += characters[ random() % characters.size() ];
+    }
+    return text;
+  }
+
+  using RankedCandidate = ResultAnd<const Candidate*>;
+
+  // The ranking, feature by feature, as Result::operator< did it before
+  // results had sort keys.
+  bool RanksBefore( const RankedCandidate& first,
+                    const RankedCandidate& second,
+                    const Word& query )
+  {
+    const Candidate& a = *first.extra_object_;
+    const Candidate& b = *second.extra_object_;
+    if ( !query.IsEmpty() )
+    {
+      bool a_first_char_same =
+        a.Characters()[ 0 ]->EqualsBase( *query.Characters()[ 0 ] );
+      bool b_first_char_same =
+        b.Characters()[ 0 ]->EqualsBase( *query.Characters()[ 0 ] );
+      if ( a_first_char_same != b_first_char_same )
+      {
+        return a_first_char_same;
+      }
+
+      size_t a_wb_matches = LongestCommonSubsequenceLength(
+        query.Characters(), a.WordBoundaryChars() );
+      size_t b_wb_matches = LongestCommonSubsequenceLength(
+        query.Characters(), b.WordBoundaryChars() );
+      size_t a_wb_chars = a.WordBoundaryChars().size();
+      size_t b_wb_chars = b.WordBoundaryChars().size();
+      if ( a_wb_matches == query.Length() || b_wb_matches == query.Length() )
+      {
+        if ( a_wb_matches != b_wb_matches )
+        {
+          return a_wb_matches > b_wb_matches;
+        }
+        if ( a_wb_chars != b_wb_chars )
+        {
+          return a_wb_chars < b_wb_chars;
+        }
+      }
+
+      bool a_prefix = first.result_.QueryIsCandidatePrefix();
+      bool b_prefix = second.result_.QueryIsCandidatePrefix();
+      if ( a_prefix != b_prefix )
+      {
+        return a_prefix;
+      }
+      if ( a_wb_matches != b_wb_matches )
+      {
+        return a_wb_matches > b_wb_matches;
+      }
+      if ( a_wb_chars != b_wb_chars )
+      {
+        return a_wb_chars < b_wb_chars;
+      }
+      if ( first.result_.CharMatchIndexSum() !=
+           second.result_.CharMatchIndexSum() )
+      {
+        return first.result_.CharMatchIndexSum() <
+               second.result_.CharMatchIndexSum();
+      }
+      if ( a.Length() != b.Length() )
+      {
+        return a.Length() < b.Length();
+      }
+      if ( a.TextIsLowercase() != b.TextIsLowercase() )
+      {
+        return a.TextIsLowercase();
+      }
+    }
+    return a.CaseSwappedText() < b.CaseSwappedText();
+  }
+
+  std::vector<const Candidate*> CandidatesOf(
+    const std::vector<RankedCandidate>& ranked )
+  {
+    std::vector<const Candidate*> candidates;
+    for ( const auto& r : ranked )
+    {
+      candidates.push_back( r.extra_object_ );
+    }
+    return candidates;
+  }
+}
+
+TEST( ResultTest, LcsLengthAgreesWithDynamicProgramming )
+{
+  std::mt19937 random( 42 );
+  // Lengths on both sides of the 64 characters in a word of bits, and of the
+  // sequences which are kept on the stack.
+  for ( size_t max_length : { 8, 70, 140, 300 } )
+  {
+    for ( size_t i = 0; i < 200; ++i )
+    {
+      Word first( RandomText( random() % ( max_length + 1 ), random ) );
+      Word second( RandomText( random() % ( max_length + 1 ), random ) );
+      ASSERT_EQ( LongestCommonSubsequenceLength( first.Characters(),
+                                                 second.Characters() ),
+                 ExpectedLcsLength( first.Characters(),
+                                    second.Characters() ) )
+        << first.Text() << " / " << second.Text();
+    }
+  }
+}
+
+TEST( ResultTest, SortKeysRankLikeTheFeatures )
+{
+  std::mt19937 random( 7 );
+  std::vector<std::string> texts;
+  for ( size_t i = 0; i < 2000; ++i )
+  {
+    texts.push_back( RandomText( 1 + random() % 12, random ) );
+  }
+  // Features too large for the bits they have in the key: many word boundary
+  // characters, long candidates and large sums of matched indexes. The
+  // repository doesn't keep such long candidates, so they are made here, with
+  // texts which no random one has.
+  std::vector<std::string> long_texts;
+  std::string word_boundaries = "y";
+  for ( size_t i = 0; i < 300; ++i )
+  {
+    word_boundaries += "aB";
+    long_texts.push_back( word_boundaries );
+  }
+  for ( size_t i = 0; i < 20; ++i )
+  {
+    long_texts.push_back( std::string( 17000 + i % 3, 'x' ) +
+                          RandomText( 4, random ) );
+    long_texts.push_back( "ab" + std::string( 17000 + i % 3, 'x' ) +
+                          RandomText( 4, random ) );
+  }
+  long_texts.push_back( std::string( 1100000, 'x' ) + "abab" );
+  long_texts.push_back( std::string( 1100000, 'x' ) + "ABab" );
+  long_texts.push_back( std::string( 1100001, 'x' ) + "abab" );
+
+  auto candidates = Repository<Candidate>::Instance().GetElements(
+    std::move( texts ) );
+  std::vector<Candidate> long_candidates;
+  long_candidates.reserve( long_texts.size() );
+  for ( auto& text : long_texts )
+  {
+    candidates.push_back( &long_candidates.emplace_back( std::move( text ) ) );
+  }
+
+  for ( const char* text : { "", "a", "ab", "AB", "ba", "abab", "é", "aBx",
+                             "yb" } )
+  {
+    Word query( text );
+    SCOPED_TRACE( text );
+    std::vector<RankedCandidate> ranked;
+    TopResults<RankedCandidate> all( 0 );
+    TopResults<RankedCandidate> best( 50 );
+    for ( const Candidate* candidate : candidates )
+    {
+      Result result = candidate->QueryMatchResult( query );
+      if ( result.IsSubsequence() )
+      {
+        ranked.emplace_back( result, candidate );
+        all.Add( ranked.back() );
+        best.Add( ranked.back() );
+      }
+    }
+    ASSERT_GT( ranked.size(), 50 );
+
+    auto expected = ranked;
+    std::sort( expected.begin(),
+               expected.end(),
+               [ &query ]( const auto& first, const auto& second )
+               {
+                 return RanksBefore( first, second, query );
+               } );
+    std::sort( ranked.begin(), ranked.end() );
+    EXPECT_EQ( CandidatesOf( ranked ), CandidatesOf( expected ) );
+    EXPECT_EQ( CandidatesOf( all.Take() ), CandidatesOf( expected ) );
+
+    expected.erase( expected.begin() + 50, expected.end() );
+    EXPECT_EQ( CandidatesOf( best.Take() ), CandidatesOf( expected ) );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
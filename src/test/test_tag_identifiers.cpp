@@ -0,0 +1,51 @@
+#include "core/IdentifierUtils.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+namespace
+{
+  FiletypeIdentifierMap Extract( const std::vector<std::string>& lines )
+  {
+    return ExtractIdentifiersFromTagLines( lines.cbegin(),
+                                           lines.cend(),
+                                           "/ycmd_tags/tags" );
+  }
+}
+
+TEST( ExtractIdentifiersFromTagLinesTest, GroupsByFiletypeAndFile )
+{
+  auto identifiers = Extract( {
+    "!_TAG_FILE_FORMAT\t2\t/extended format/",
+    "foo\tfoo.cpp\t/^int foo;$/;\"\tkind:v\tlanguage:C++",
+    "bar\tsub/bar.py\t/^bar = 1$/;\"\tlanguage:Python\r",
+    "baz\tfoo.cpp\t/^int baz;$/;\"\tlanguage:C++\tkind:v" } );
+
+  EXPECT_EQ( identifiers.size(), 2 );
+  EXPECT_EQ( identifiers[ "cpp" ][ "/ycmd_tags/foo.cpp" ],
+             ( std::vector<std::string>{ "foo", "baz" } ) );
+  EXPECT_EQ( identifiers[ "python" ][ "/ycmd_tags/sub/bar.py" ],
+             std::vector<std::string>{ "bar" } );
+}
+
+TEST( ExtractIdentifiersFromTagLinesTest, SkipsMalformedIdentifiers )
+{
+  // A malformed name only loses its own line, not the rest of the file.
+  auto identifiers = Extract( {
+    "foo\tfoo.cpp\t/^int foo;$/;\"\tlanguage:C++",
+    "b\xC3(r\tfoo.cpp\t/^int bar;$/;\"\tlanguage:C++",
+    "\xE2\x82\tfoo.cpp\t/^int x;$/;\"\tlanguage:C++",
+    "caf\xC3\xA9\tfoo.cpp\t/^int cafe;$/;\"\tlanguage:C++" } );
+
+  EXPECT_EQ( identifiers[ "cpp" ][ "/ycmd_tags/foo.cpp" ],
+             ( std::vector<std::string>{ "foo", "caf\xC3\xA9" } ) );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,121 @@
+#include "core/Candidate.h"
+#include "core/Character.h"
+#include "core/Word.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace YouCompleteMe;
+
+TEST( WordTest, AsciiWordsAreBrokenLikeOthers )
+{
+  // ASCII text skips breaking into code points, which a trailing non-ASCII
+  // character forces.
+  std::mt19937 random( 5678 );
+  std::vector<std::string> texts{ "", "\r", "\n\r", "a\r\nb", "foo_Bar-1" };
+  for ( size_t i = 0; i < 500; ++i )
+  {
+    std::string text;
+    for ( size_t length = random() % 20; length > 0; --length )
+    {
+      text += static_cast<char>( random() % 128 );
+    }
+    texts.push_back( text );
+  }
+
+  Candidate accent( "é" );
+  for ( const auto& text : texts )
+  {
+    SCOPED_TRACE( text );
+    Candidate ascii( std::string{ text } );
+    Candidate other( text + "é" );
+
+    std::vector<const Character*> expected_characters(
+      other.Characters().begin(), other.Characters().end() - 1 );
+    EXPECT_EQ( ascii.Characters(), expected_characters );
+    EXPECT_EQ( ascii.CaseSwappedText() + accent.CaseSwappedText(),
+               other.CaseSwappedText() );
+    EXPECT_EQ( ascii.BytesPresentMask() | accent.BytesPresentMask(),
+               other.BytesPresentMask() );
+    EXPECT_TRUE( other.ContainsBytes( ascii ) );
+  }
+}
+
+TEST( WordTest, ExtendedWordsAreLikeWholeOnes )
+{
+  auto expect_same = []( const Word& extended, const Word& whole )
+  {
+    SCOPED_TRACE( whole.Text() );
+    EXPECT_EQ( extended.Text(), whole.Text() );
+    EXPECT_EQ( extended.Characters(), whole.Characters() );
+    EXPECT_EQ( extended.PackedCharacters(), whole.PackedCharacters() );
+    EXPECT_EQ( extended.BytesPresentMask(), whole.BytesPresentMask() );
+    EXPECT_TRUE( extended.ContainsBytes( whole ) );
+    EXPECT_TRUE( whole.ContainsBytes( extended ) );
+  };
+
+  // Suffixes which change the last character of the prefix, or not.
+  std::vector<std::string> texts{ "", "g", "Get", "a\r", "\n", "b\r\n", "é",
+                                  "e", "\xCC\x81", "_1", "ß", "x\xCC\x81y" };
+  for ( const auto& prefix : texts )
+  {
+    for ( const auto& suffix : texts )
+    {
+      Word prefix_word( prefix );
+      expect_same( Word( prefix_word, suffix ), Word( prefix + suffix ) );
+    }
+  }
+
+  // Typing a query, deleting a character and typing again
+  for ( const char* query : { "g", "ge", "get", "ge", "geT", "geTé", "ge" } )
+  {
+    auto word = QueryWord( query );
+    expect_same( *word, Word( query ) );
+    EXPECT_EQ( QueryWord( query ), word );
+  }
+}
+
+TEST( WordTest, WordsAreBrokenIntoGraphemeClusters )
+{
+  // Cases from each of the rules in
+  // https://www.unicode.org/Public/13.0.0/ucd/auxiliary/GraphemeBreakTest.txt
+  const std::vector<std::vector<std::string>> cases{
+    { "\r\n", "a" },
+    { "\n", "\r", "a" },
+    { "\x01", "a\xCC\x88" },
+    { "a\xCC\x88\xCC\x81", "\x01" },
+    { "\u1100\u1100\u1161\u11A8", "\u1161" },
+    { "\uAC00\u11A8", "\uAC01\u11A8", "\u1161" },
+    { "\u0600a", "\u0600", "\r" },
+    { "a\u0903\u0903", "a" },
+    { "\U0001F1E6\U0001F1E7", "\U0001F1E6\U0001F1E7", "\U0001F1E6\u200D" },
+    { "\U0001F476\U0001F3FB\u200D\U0001F476", "\U0001F476" },
+    { "a\u200D", "\U0001F476\u200D\u200D", "\U0001F476" },
+    { "\u4E2D", "\u6587", "_", "\u4E2D" } };
+
+  for ( const auto& characters : cases )
+  {
+    std::string text;
+    for ( const auto& character : characters )
+    {
+      text += character;
+    }
+    SCOPED_TRACE( text );
+
+    Word word( text );
+    ASSERT_EQ( word.Characters().size(), characters.size() );
+    for ( size_t i = 0; i < characters.size(); ++i )
+    {
+      EXPECT_EQ( word.Characters()[ i ]->Normal(),
+                 NormalizeInput( characters[ i ] ) );
+    }
+  }
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
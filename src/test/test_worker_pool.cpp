@@ -0,0 +1,194 @@
+#include "../worker_pool.cpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace ycmd;
+
+namespace
+{
+  // Runs the coroutine to completion on ctx on this thread, like the server
+  // does. The pool must be destroyed before ctx, as the last worker can still
+  // be finishing up the post back to it when the coroutine completes.
+  template< typename F >
+  void RunOnIoContext( asio::io_context& ctx, F f )
+  {
+    asio::co_spawn( ctx, f(), []( std::exception_ptr e ) {
+      if ( e )
+      {
+        std::rethrow_exception( e );
+      }
+    } );
+    ctx.run();
+  }
+}
+
+TEST( WorkerPoolTest, ParallelForEachVisitsEverything )
+{
+  asio::io_context ctx;
+  WorkerPool pool( 4 );
+  std::vector<size_t> items( 1000 );
+  std::iota( items.begin(), items.end(), 0 );
+  auto caller = std::this_thread::get_id();
+  bool resumed_on_caller = false;
+
+  RunOnIoContext( ctx, [ & ]() -> Async<void> {
+    co_await parallel_for_each( pool, items, []( size_t& item ) {
+      item *= 2;
+    } );
+    resumed_on_caller = std::this_thread::get_id() == caller;
+  } );
+
+  EXPECT_TRUE( resumed_on_caller );
+  for ( size_t i = 0; i < items.size(); ++i )
+  {
+    EXPECT_EQ( items[ i ], i * 2 );
+  }
+}
+
+TEST( WorkerPoolTest, ParallelForEachRunsOnThePool )
+{
+  asio::io_context ctx;
+  WorkerPool pool( 2 );
+  std::vector<std::thread::id> items( 16 );
+  auto caller = std::this_thread::get_id();
+
+  RunOnIoContext( ctx, [ & ]() -> Async<void> {
+    co_await parallel_for_each( pool, items, []( std::thread::id& item ) {
+      item = std::this_thread::get_id();
+    } );
+  } );
+
+  for ( auto id : items )
+  {
+    EXPECT_NE( id, caller );
+    EXPECT_NE( id, std::thread::id{} );
+  }
+}
+
+TEST( WorkerPoolTest, ParallelForEachEmpty )
+{
+  asio::io_context ctx;
+  WorkerPool pool( 1 );
+  std::vector<int> items;
+  bool finished = false;
+
+  RunOnIoContext( ctx, [ & ]() -> Async<void> {
+    co_await parallel_for_each( pool, items, []( int& ) {
+      FAIL() << "Nothing to do";
+    } );
+    finished = true;
+  } );
+
+  EXPECT_TRUE( finished );
+}
+
+TEST( WorkerPoolTest, ParallelForEachRethrows )
+{
+  asio::io_context ctx;
+  WorkerPool pool( 2 );
+  std::vector<int> items{ 1, 2, 3, 4 };
+  std::atomic<int> completed = 0;
+  bool caught = false;
+
+  RunOnIoContext( ctx, [ & ]() -> Async<void> {
+    try
+    {
+      co_await parallel_for_each( pool, items, [ & ]( int& item ) {
+        if ( item == 3 )
+        {
+          throw std::runtime_error( "bang" );
+        }
+        ++completed;
+      } );
+    }
+    catch ( const std::runtime_error& e )
+    {
+      caught = std::string_view( e.what() ) == "bang";
+    }
+  } );
+
+  EXPECT_TRUE( caught );
+  EXPECT_EQ( completed, 3 );
+}
+
+TEST( WorkerPoolTest, RunParallelRunsEveryTaskOnce )
+{
+  WorkerPool pool( 4 );
+  std::vector<std::atomic<int>> runs( 1000 );
+
+  run_parallel( pool, 4, runs.size(), [ & ]( size_t task ) {
+    ++runs[ task ];
+  } );
+
+  for ( auto& count : runs )
+  {
+    EXPECT_EQ( count, 1 );
+  }
+}
+
+TEST( WorkerPoolTest, RunParallelDoesntWaitForBusyWorkers )
+{
+  // Declared before the pool, which is still running the busy worker's job
+  // when the test returns.
+  std::atomic<bool> release = false;
+  WorkerPool pool( 1 );
+  asio::post( pool, [ & ]() {
+    while ( !release )
+    {
+      std::this_thread::yield();
+    }
+  } );
+
+  // The only worker is busy, so the caller runs all of the tasks itself.
+  auto caller = std::this_thread::get_id();
+  std::vector<std::thread::id> ran_on( 8 );
+  run_parallel( pool, 2, ran_on.size(), [ & ]( size_t task ) {
+    ran_on[ task ] = std::this_thread::get_id();
+  } );
+  release = true;
+
+  for ( auto id : ran_on )
+  {
+    EXPECT_EQ( id, caller );
+  }
+}
+
+TEST( WorkerPoolTest, RunParallelRethrows )
+{
+  WorkerPool pool( 2 );
+  std::atomic<int> completed = 0;
+  bool caught = false;
+
+  try
+  {
+    run_parallel( pool, 2, 4, [ & ]( size_t task ) {
+      if ( task == 2 )
+      {
+        throw std::runtime_error( "bang" );
+      }
+      ++completed;
+    } );
+  }
+  catch ( const std::runtime_error& e )
+  {
+    caught = std::string_view( e.what() ) == "bang";
+  }
+
+  EXPECT_TRUE( caught );
+  EXPECT_EQ( completed, 3 );
+}
+
+int main( int argc, char** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
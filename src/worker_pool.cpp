@@ -0,0 +1,181 @@
+#pragma once
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ycmd.hpp"
+
+namespace ycmd
+{
+  // Threads for CPU-bound work (lexing buffers, parsing tag files), so that it
+  // can use all of the cores, and doesn't hold up the I/O thread.
+  using WorkerPool = asio::thread_pool;
+
+  inline size_t default_worker_count()
+  {
+    return std::max( 1u, std::thread::hardware_concurrency() );
+  }
+
+  // Calls f( item ) for each of the items on the pool, and resumes the caller
+  // on its own executor once they have all finished. The caller must make sure
+  // that no two items share mutable state.
+  //
+  // If any call throws, the others still run to completion, and then one of
+  // the exceptions is rethrown.
+  template< typename Items, typename F >
+  Async<void> parallel_for_each( WorkerPool& pool, Items& items, F f )
+  {
+    if ( std::empty( items ) )
+    {
+      co_return;
+    }
+
+    auto executor = co_await asio::this_coro::executor;
+    std::exception_ptr error;
+
+    co_await asio::async_initiate< decltype( asio::use_awaitable ), void() >(
+      [ & ]( auto handler ) {
+        using Handler = decltype( handler );
+        struct State
+        {
+          State( Handler handler, size_t remaining )
+            : handler( std::move( handler ) ),
+              remaining( remaining )
+          {
+          }
+
+          Handler handler;
+          std::atomic<size_t> remaining;
+          std::mutex error_mutex;
+        };
+        auto state = std::make_shared<State>( std::move( handler ),
+                                              std::size( items ) );
+
+        for ( auto& item : items )
+        {
+          asio::post( pool, [ state, &item, &f, &error, executor ]() {
+            try
+            {
+              f( item );
+            }
+            catch ( ... )
+            {
+              std::lock_guard lock( state->error_mutex );
+              if ( !error )
+              {
+                error = std::current_exception();
+              }
+            }
+
+            // The last one resumes the caller, back on its executor.
+            if ( state->remaining.fetch_sub( 1 ) == 1 )
+            {
+              asio::post( executor, std::move( state->handler ) );
+            }
+          } );
+        }
+      },
+      asio::use_awaitable );
+
+    if ( error )
+    {
+      std::rethrow_exception( error );
+    }
+  }
+
+  // Calls task( 0 ), ..., task( num_tasks - 1 ) on up to num_threads threads
+  // of the pool and the calling thread, and returns once they have all
+  // finished. Unlike parallel_for_each, this blocks the caller, which is what
+  // a short burst of work on data that mustn't change in the meantime needs:
+  // the I/O thread can't run anything else until it's done.
+  //
+  // The caller takes tasks too, and the workers only take the tasks which are
+  // left when they get to them, so the caller never waits for workers which
+  // are busy with something else.
+  //
+  // If any task throws, the others still run to completion, and then one of
+  // the exceptions is rethrown.
+  inline void run_parallel( WorkerPool& pool,
+                            size_t num_threads,
+                            size_t num_tasks,
+                            const std::function<void( size_t )>& task )
+  {
+    if ( num_tasks == 0 )
+    {
+      return;
+    }
+
+    struct State
+    {
+      const std::function<void( size_t )>* task;
+      size_t num_tasks;
+      std::atomic<size_t> next{ 0 };
+      size_t finished = 0;
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable all_finished;
+
+      // Runs tasks until there are none left to take.
+      void run()
+      {
+        for ( size_t index = next.fetch_add( 1 ); index < num_tasks;
+              index = next.fetch_add( 1 ) )
+        {
+          std::exception_ptr task_error;
+          try
+          {
+            ( *task )( index );
+          }
+          catch ( ... )
+          {
+            task_error = std::current_exception();
+          }
+
+          std::lock_guard lock( mutex );
+          if ( task_error && !error )
+          {
+            error = task_error;
+          }
+          if ( ++finished == num_tasks )
+          {
+            all_finished.notify_one();
+          }
+        }
+      }
+    };
+
+    // Workers which only start once all of the tasks are taken just drop
+    // their reference, so the state has to outlive the call.
+    auto state = std::make_shared<State>();
+    state->task = &task;
+    state->num_tasks = num_tasks;
+
+    size_t num_helpers = std::min( std::max<size_t>( num_threads, 1 ),
+                                   num_tasks ) - 1;
+    for ( size_t i = 0; i < num_helpers; ++i )
+    {
+      asio::post( pool, [ state ]() { state->run(); } );
+    }
+    state->run();
+
+    std::unique_lock lock( state->mutex );
+    state->all_finished.wait(
+      lock, [ &state ]() { return state->finished == state->num_tasks; } );
+    if ( state->error )
+    {
+      std::rethrow_exception( state->error );
+    }
+  }
+}